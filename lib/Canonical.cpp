@@ -0,0 +1,266 @@
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "Canonical.hpp"
+#include "util/intrinsic.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+// Maximum number of orderings of pegs and colors with equal signatures
+// to try in total.
+static const int MaxTieOrders = 24;
+
+CanonicalLabeler::CanonicalLabeler(const Rules &rules) : _rules(rules)
+{
+}
+
+// Finds groups of adjacent elements in order[0..n) that compare equal
+// and stores them in (group_begin, group_end). Groups of a single element
+// and groups that are not selected are skipped. If there are more than
+// max_orders ways to order the elements in the groups, no group is
+// returned. The number of ways is stored in norders.
+template <class Equal, class Select>
+static int find_tie_groups(
+	const int order[], int n, Equal equal, Select select,
+	int max_orders, int &norders, int group_begin[], int group_end[])
+{
+	int ngroups = 0;
+	norders = 1;
+	for (int r = 0; r < n; )
+	{
+		int s = r + 1;
+		while (s < n && equal(order[r], order[s]))
+			++s;
+		if (s - r > 1 && select(order[r]))
+		{
+			for (int k = 2; k <= s - r && norders <= max_orders; ++k)
+				norders *= k;
+			group_begin[ngroups] = r;
+			group_end[ngroups] = s;
+			++ngroups;
+		}
+		r = s;
+	}
+	if (norders > max_orders)
+	{
+		norders = 1;
+		return 0;
+	}
+	return ngroups;
+}
+
+// Advances to the next ordering of the elements within the tie groups.
+// Returns false if all orderings have been enumerated.
+static bool next_tie_order(
+	int order[], int ngroups, const int group_begin[], const int group_end[])
+{
+	for (int g = 0; g < ngroups; ++g)
+	{
+		if (std::next_permutation(order + group_begin[g], order + group_end[g]))
+			return true;
+	}
+	return false;
+}
+
+void CanonicalLabeler::label(
+	CodewordConstRange codewords,
+	CanonicalLabel &result) const
+{
+	const int p = _rules.pegs(), c = _rules.colors();
+	const size_t n = codewords.size();
+
+	UPDATE_CALL_COUNTER("CanonicalLabeler_Label", (unsigned int)n);
+
+	// Count the occurrence of each color on each peg, and make a copy
+	// of the digits for quick access.
+	unsigned int count[MM_MAX_COLORS][MM_MAX_PEGS] = { { 0 } };
+	std::vector<int8_t> digits(n * p);
+	for (size_t k = 0; k < n; ++k)
+	{
+		for (int i = 0; i < p; ++i)
+		{
+			int x = codewords[k][i];
+			digits[k*p+i] = (int8_t)x;
+			++count[x][i];
+		}
+	}
+
+	// The signature of a peg is the occurrence counts of the colors on
+	// that peg, in descending order. It is invariant under a color
+	// permutation. Canonical labelings order the pegs by signature.
+	unsigned int psig[MM_MAX_PEGS][MM_MAX_COLORS];
+	for (int i = 0; i < p; ++i)
+	{
+		for (int x = 0; x < c; ++x)
+			psig[i][x] = count[x][i];
+		std::sort(psig[i] + 0, psig[i] + c, std::greater<unsigned int>());
+	}
+	auto peg_greater = [&](int i, int j) -> bool {
+		return std::lexicographical_compare(psig[j], psig[j] + c, psig[i], psig[i] + c);
+	};
+	auto peg_equal = [&](int i, int j) -> bool {
+		return std::equal(psig[i], psig[i] + c, psig[j]);
+	};
+
+	int porder[MM_MAX_PEGS];
+	for (int i = 0; i < p; ++i)
+		porder[i] = i;
+	std::stable_sort(porder + 0, porder + p, peg_greater);
+
+	int pgroup_begin[MM_MAX_PEGS], pgroup_end[MM_MAX_PEGS], npegorders;
+	int npgroups = find_tie_groups(porder, p, peg_equal,
+		[](int) -> bool { return true; }, MaxTieOrders, npegorders,
+		pgroup_begin, pgroup_end);
+
+	// Base value of a packed codeword (see Codeword::pack()).
+	const Codeword::compact_type base = (p < 8)?
+		(Codeword::compact_type)(0xffffffff << (4*p)) : 0;
+
+	std::vector<Codeword::compact_type> image(n);
+	bool first = true;
+	do
+	{
+		// Position of each peg after the permutation.
+		int pos[MM_MAX_PEGS];
+		for (int r = 0; r < p; ++r)
+			pos[porder[r]] = r;
+
+		// The signature of a color is its occurrence count on each peg
+		// after the pegs are permuted.
+		unsigned int sig[MM_MAX_COLORS][MM_MAX_PEGS];
+		for (int x = 0; x < c; ++x)
+		{
+			for (int i = 0; i < p; ++i)
+				sig[x][pos[i]] = count[x][i];
+		}
+		auto color_greater = [&](int x, int y) -> bool {
+			return std::lexicographical_compare(sig[y], sig[y] + p, sig[x], sig[x] + p);
+		};
+		auto color_equal = [&](int x, int y) -> bool {
+			return std::equal(sig[x], sig[x] + p, sig[y]);
+		};
+		auto color_present = [&](int x) -> bool {
+			return std::count(sig[x], sig[x] + p, 0u) < p;
+		};
+
+		// Order the colors by their signature in descending order.
+		int corder[MM_MAX_COLORS];
+		for (int x = 0; x < c; ++x)
+			corder[x] = x;
+		std::stable_sort(corder + 0, corder + c, color_greater);
+
+		int cgroup_begin[MM_MAX_COLORS], cgroup_end[MM_MAX_COLORS], ncolororders;
+		int ncgroups = find_tie_groups(corder, c, color_equal, color_present,
+			MaxTieOrders / npegorders, ncolororders, cgroup_begin, cgroup_end);
+
+		// Try each ordering of the colors within the groups.
+		do
+		{
+			int color[MM_MAX_COLORS];
+			for (int r = 0; r < c; ++r)
+				color[corder[r]] = r;
+
+			for (size_t k = 0; k < n; ++k)
+			{
+				Codeword::compact_type w = base;
+				for (int i = 0; i < p; ++i)
+					w |= (Codeword::compact_type)color[digits[k*p+i]] << (4*(p-1-pos[i]));
+				image[k] = w;
+			}
+			std::sort(image.begin(), image.end());
+
+			if (first || image < result.key)
+			{
+				result.key.swap(image);
+				image.resize(n);
+				result.perm = CodewordPermutation();
+				for (int i = 0; i < p; ++i)
+					result.perm.peg[i] = (int8_t)pos[i];
+				for (int x = 0; x < c; ++x)
+					result.perm.color[x] = (int8_t)color[x];
+				first = false;
+			}
+		}
+		while (next_tie_order(corder, ncgroups, cgroup_begin, cgroup_end));
+	}
+	while (next_tie_order(porder, npgroups, pgroup_begin, pgroup_end));
+}
+
+OrbitTable::OrbitTable(const Engine *e) : _rules(e->rules())
+{
+	CodewordConstRange all = e->universe();
+	for (size_t k = 0; k < all.size(); ++k)
+	{
+		// The representative is the smallest codeword of the orbit, so it
+		// comes before the other codewords of the orbit in the universe.
+		const Codeword &w = all[k];
+		Codeword rep = permutation(w).permute(w);
+		assert(index(w) == k);
+		assert(index(rep) <= k && permutation(rep).permute(rep) == rep);
+		if (rep == w)
+			_representatives.push_back(rep);
+	}
+}
+
+CodewordPermutation OrbitTable::permutation(const Codeword &w) const
+{
+	// Map the colors in descending order of their occurrence count (and
+	// ascending order of the colors for equal counts) to the colors 0, 1,
+	// 2, ..., and move the pegs of each color, in order, next to each
+	// other. The colors and pegs are bucketed by count.
+	const int p = _rules.pegs(), c = _rules.colors();
+	int ncolors[MM_MAX_PEGS+1] = { 0 };
+	for (int x = 0; x < c; ++x)
+		++ncolors[w.count(x)];
+	int rank[MM_MAX_PEGS+1], offset[MM_MAX_PEGS+1];
+	for (int n = p, r = 0, i = 0; n >= 0; --n)
+	{
+		rank[n] = r;
+		offset[n] = i;
+		r += ncolors[n];
+		i += n * ncolors[n];
+	}
+
+	CodewordPermutation perm;
+	int next[MM_MAX_COLORS] = { 0 };
+	for (int x = 0; x < c; ++x)
+	{
+		int n = w.count(x);
+		perm.color[x] = (int8_t)(rank[n]++);
+		next[x] = offset[n];
+		offset[n] += n;
+	}
+	for (int i = 0; i < p; ++i)
+		perm.peg[i] = (int8_t)(next[w[i]]++);
+	return perm;
+}
+
+size_t OrbitTable::index(const Codeword &w) const
+{
+	// The index is a mixed-radix number whose i-th digit is the rank of
+	// the color on peg i among the colors still available.
+	const int p = _rules.pegs(), c = _rules.colors();
+	size_t k = 0;
+	if (_rules.repeatable())
+	{
+		for (int i = 0; i < p; ++i)
+			k = k * c + w[i];
+	}
+	else
+	{
+		unsigned int used = 0;
+		for (int i = 0; i < p; ++i)
+		{
+			int x = w[i];
+			int rank = x - util::intrinsic::pop_count(used & ((1u << x) - 1));
+			k = k * (c - i) + rank;
+			used |= 1u << x;
+		}
+	}
+	return k;
+}
+
+} // namespace Mastermind
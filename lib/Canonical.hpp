@@ -0,0 +1,92 @@
+#ifndef MASTERMIND_CANONICAL_HPP
+#define MASTERMIND_CANONICAL_HPP
+
+#include <vector>
+#include <cstdint>
+#include "Engine.hpp"
+#include "Permutation.hpp"
+
+namespace Mastermind {
+
+/// Canonical form of a set of codewords under peg and color permutations.
+/// @ingroup equiv
+struct CanonicalLabel
+{
+	/// Permutation that maps the set of codewords to its canonical form.
+	CodewordPermutation perm;
+
+	/// Compact values of the permuted codewords, in ascending order.
+	/// Two sets that have the same key are equivalent: the permutation
+	/// <code>b.perm.inverse() * a.perm</code> maps set @c a onto set @c b.
+	std::vector<Codeword::compact_type> key;
+};
+
+/**
+ * Computes a canonical labeling of a set of codewords. The pegs are
+ * ordered by the (sorted) occurrence counts of the colors on each peg,
+ * and the colors are then ordered by their occurrence count on each
+ * peg. Pegs or colors that cannot be told apart this way are tried in
+ * every order if there are only a few ways to do so. The labeling that
+ * produces the lexicographically smallest set of permuted codewords is
+ * chosen.
+ *
+ * The labeling is not guaranteed to be complete, i.e. two equivalent sets
+ * may occasionally receive different keys; but two sets with the same key
+ * are always equivalent. This is sufficient for caching purposes.
+ *
+ * @ingroup equiv
+ */
+class CanonicalLabeler
+{
+	Rules _rules;
+
+public:
+
+	/// Constructs a labeler for the given rules.
+	explicit CanonicalLabeler(const Rules &rules);
+
+	/// Computes the canonical label of a set of codewords.
+	void label(CodewordConstRange codewords, CanonicalLabel &result) const;
+};
+
+/**
+ * Table of the orbits of the codewords under all peg and color
+ * permutations. Two codewords are in the same orbit if and only if they
+ * have the same color multiplicities, e.g. 1223 and 4541. The smallest
+ * codeword of an orbit is its representative, e.g. 0012.
+ *
+ * Only the representatives are stored. They are the canonical guesses
+ * when no guess has been made, as returned by the constraint equivalence
+ * filter. The permutation that maps a codeword to its representative is
+ * computed on demand in O(pegs + colors).
+ *
+ * @ingroup equiv
+ */
+class OrbitTable
+{
+	Rules _rules;
+	CodewordList _representatives;
+
+public:
+
+	/// Builds the orbit table of all codewords of the given engine.
+	explicit OrbitTable(const Engine *e);
+
+	/// Returns the index of a codeword in the universe, which lists the
+	/// codewords in lexicographical order.
+	size_t index(const Codeword &w) const;
+
+	/// Returns a permutation that maps a codeword to the representative
+	/// of its orbit.
+	CodewordPermutation permutation(const Codeword &w) const;
+
+	/// Returns the number of orbits.
+	size_t size() const { return _representatives.size(); }
+
+	/// Returns the representatives of all orbits in ascending order.
+	CodewordConstRange representatives() const { return _representatives; }
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_CANONICAL_HPP
@@ -0,0 +1,110 @@
+#ifndef MASTERMIND_CANONICAL_GUESS_CACHE_HPP
+#define MASTERMIND_CANONICAL_GUESS_CACHE_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "Engine.hpp"
+#include "Equivalence.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+/**
+ * Bounded cache of the canonical guesses returned by equivalence filters.
+ *
+ * The optimal strategy search filters all codewords at each state it
+ * visits, but the canonical guesses only depend on the state of the
+ * filters, which is shared by many states: after a few guesses, most
+ * states keep only the identity permutation, and different guesses
+ * often restrict the permutations in the same way. The cache maps the
+ * state key of a chain of filters (see
+ * <code>EquivalenceFilter::append_state_key()</code>) to the canonical
+ * guesses, which are stored as their indices in the universe (see
+ * <code>EquivalenceFilter::narrow_canonical_guesses()</code>).
+ *
+ * Entries are never replaced; once the memory limit is reached, new
+ * results are no longer stored. The cache may be accessed concurrently
+ * by multiple threads.
+ *
+ * @ingroup Optimal
+ */
+class CanonicalGuessCache
+{
+public:
+
+	/// Identifies the state of a chain of filters.
+	typedef std::string Key;
+
+private:
+
+	std::unordered_map<Key, std::shared_ptr<const CodewordIndexList>> _entries;
+	size_t _capacity;
+	size_t _used;
+
+public:
+
+	/// Creates a cache that takes up to about the given number of bytes
+	/// of memory.
+	explicit CanonicalGuessCache(size_t bytes) : _capacity(bytes), _used(0) { }
+
+	/// Computes the key of a chain of filters. The filters are applied
+	/// in order, the first one to the universe.
+	static Key make_key(
+		const EquivalenceFilter *filter1,
+		const EquivalenceFilter *filter2 = NULL)
+	{
+		Key key(1, (char)(filter2? 2 : 1));
+		filter1->append_state_key(key);
+		if (filter2)
+			filter2->append_state_key(key);
+		return key;
+	}
+
+	/// Looks up the canonical guesses of a chain of filters. Returns
+	/// @c true and stores their indices in the universe in @c subset if
+	/// they are found.
+	bool probe(const Key &key, CodewordIndexList &subset) const
+	{
+		std::shared_ptr<const CodewordIndexList> indices;
+		#pragma omp critical (CanonicalGuessCache_Access)
+		{
+			auto it = _entries.find(key);
+			if (it != _entries.end())
+				indices = it->second;
+		}
+		if (!indices)
+		{
+			UPDATE_CALL_COUNTER("CanonicalGuessCache_Miss", 0);
+			return false;
+		}
+
+		subset = *indices;
+		UPDATE_CALL_COUNTER("CanonicalGuessCache_Hit",
+			(unsigned int)subset.size());
+		return true;
+	}
+
+	/// Stores the canonical guesses of a chain of filters, given by their
+	/// indices in the universe.
+	void store(const Key &key, const CodewordIndexList &subset)
+	{
+		const size_t bytes = key.size() + subset.size() * sizeof(uint32_t);
+
+		#pragma omp critical (CanonicalGuessCache_Access)
+		if (_used + bytes <= _capacity &&
+			_entries.insert(std::make_pair(key,
+				std::make_shared<const CodewordIndexList>(subset))).second)
+		{
+			_used += bytes;
+		}
+	}
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_CANONICAL_GUESS_CACHE_HPP
@@ -1,6 +1,10 @@
+#include <string>
 #include <vector>
+#include <unordered_map>
 #include "CodeBreaker.hpp"
 #include "ObviousStrategy.hpp"
+#include "Canonical.hpp"
+#include "util/call_counter.hpp"
 
 namespace Mastermind {
 
@@ -42,6 +46,107 @@ Codeword MakeGuess(
 	return guess;
 }
 
+/// Cache of the guesses made by a strategy, keyed by the state of the
+/// equivalence filter and the canonical form of the set of remaining
+/// possibilities. A guess is stored relative to the canonical labeling,
+/// and is replayed for an equivalent set under the inverse of that set's
+/// labeling. The filter state is part of the key because it determines
+/// the candidate guesses, and therefore which of several equally good
+/// guesses the strategy makes.
+///
+/// Computing the canonical form of a set of possibilities takes time
+/// roughly proportional to its size. It is therefore only worthwhile
+/// where evaluating the candidate guesses is much more expensive.
+///
+/// Entries are never replaced; once the memory limit is reached, new
+/// guesses are no longer stored. The cache is shared by all threads that
+/// build the strategy tree.
+class GuessCache
+{
+	// Minimum amount of work to evaluate all candidates, measured in
+	// (candidates * possibilities), for the cache to be used.
+	static const size_t MinWork = 1 << 14;
+
+	CanonicalLabeler _labeler;
+
+	std::unordered_map<std::string, Codeword::compact_type> _guesses;
+	size_t _capacity;
+	size_t _used;
+
+public:
+
+	/// Creates an empty cache that takes up to about the given number of
+	/// bytes of memory.
+	GuessCache(const Rules &rules, size_t bytes)
+		: _labeler(rules), _capacity(bytes), _used(0) { }
+
+	/// Makes a guess, reusing the guess made for an equivalent set of
+	/// possibilities if one is in the cache.
+	Codeword make_guess(
+		const Engine *e,
+		CodewordConstRange secrets,
+		Strategy *strat,
+		const EquivalenceFilter *filter,
+		const CodeBreakerOptions &options)
+	{
+		// Obvious guesses are cheap to find and are not cached.
+		if (options.optimize_obvious)
+		{
+			Codeword guess = ObviousStrategy(e).make_guess(secrets, secrets);
+			if (!guess.IsEmpty())
+				return guess;
+		}
+
+		// Filter the candidate set to remove "equivalent" guesses.
+		CodewordConstRange candidates = options.possibility_only ?
+			secrets : e->universe();
+		CodewordList canonical = filter->get_canonical_guesses(candidates);
+		if (canonical.size() * secrets.size() < MinWork)
+			return strat->make_guess(secrets, canonical);
+
+		CanonicalLabel label;
+		_labeler.label(secrets, label);
+
+		std::string key;
+		filter->append_state_key(key);
+		key.append(reinterpret_cast<const char *>(label.key.data()),
+			label.key.size() * sizeof(Codeword::compact_type));
+
+		bool found = false;
+		Codeword::compact_type cached = 0;
+#if _OPENMP
+		#pragma omp critical (CodeBreaker_GuessCache)
+#endif
+		{
+			auto it = _guesses.find(key);
+			if (it != _guesses.end())
+			{
+				found = true;
+				cached = it->second;
+			}
+		}
+		UPDATE_CALL_COUNTER("GuessCache_Hit", found? 1 : 0);
+
+		if (found)
+			return label.perm.inverse().permute(Codeword::unpack(cached));
+
+		Codeword guess = strat->make_guess(secrets, canonical);
+		if (!guess.IsEmpty())
+		{
+			const size_t bytes = key.size() + sizeof(Codeword::compact_type);
+#if _OPENMP
+			#pragma omp critical (CodeBreaker_GuessCache)
+#endif
+			if (_used + bytes <= _capacity && _guesses.insert(std::make_pair(
+				key, label.perm.permute(guess).pack())).second)
+			{
+				_used += bytes;
+			}
+		}
+		return guess;
+	}
+};
+
 // Build a partial strategy tree from the given state.
 // That state has NOT been output to the tree yet.
 // The following fields must be filled in partial_node:
@@ -59,10 +164,13 @@ static void FillStrategy(
 	Strategy *strat,
 	const EquivalenceFilter *filter,
 	const CodeBreakerOptions &options,
+	GuessCache *cache,
 	int *progress)
 {
 	// Make a guess.
-	Codeword guess = MakeGuess(e, secrets, strat, filter, options);
+	Codeword guess = (cache != NULL)?
+		cache->make_guess(e, secrets, strat, filter, options) :
+		MakeGuess(e, secrets, strat, filter, options);
 	if (guess.IsEmpty())
 		return;
 
@@ -101,7 +209,7 @@ static void FillStrategy(
 
 			// Recursively build the strategy tree.
 			FillStrategy(subtree, subtree.root(), e, depth + 1, cell, strat, 
-				new_filter.get(), options, progress);
+				new_filter.get(), options, cache, progress);
 		}
 
 		// Add the subtree to the big tree.
@@ -124,8 +232,13 @@ StrategyTree BuildStrategyTree(
 
 	StrategyTree tree(e->rules());
 
+	std::unique_ptr<GuessCache> cache;
+	if (options.memoize)
+		cache.reset(new GuessCache(e->rules(), options.memo_size << 20));
+
 	int progress = 0;
-	FillStrategy(tree, tree.root(), e, 0, all, strat, filter, options, &progress);
+	FillStrategy(tree, tree.root(), e, 0, all, strat, filter, options,
+		cache.get(), &progress);
 	return tree;
 }
 
@@ -22,10 +22,20 @@ struct CodeBreakerOptions
 	/// Indicates whether to make a guess only from the remaining
 	/// possibilities.
 	bool possibility_only; 
+
+	/// Indicates whether to reuse the guess made for an equivalent set
+	/// of remaining possibilities (up to a peg and color permutation)
+	/// when building a strategy tree. This assumes that the strategy
+	/// scores a guess only by the partition it produces.
+	bool memoize;
+
+	/// Maximum size in megabytes of the guesses kept with @c memoize.
+	size_t memo_size;
 	
 	/// Creates a default set of "best" options.
 	CodeBreakerOptions()
-		: optimize_obvious(true), possibility_only(false) { }
+		: optimize_obvious(true), possibility_only(false), memoize(false),
+		memo_size(64) { }
 };
 
 /// Stores statistics about a code breaker routine.
@@ -14,8 +14,10 @@ class ColorEquivalenceFilter : public EquivalenceFilter
 	ColorMask _unguessed;
 	ColorMask _excluded;
 
-	CodewordList filter_norep(CodewordConstRange candidates) const;
-	CodewordList filter_rep(CodewordConstRange candidates) const;
+	void filter_norep(CodewordConstRange candidates,
+		CodewordIndexList &subset) const;
+	void filter_rep(CodewordConstRange candidates,
+		CodewordIndexList &subset) const;
 
 public:
 
@@ -29,22 +31,14 @@ public:
 		return new ColorEquivalenceFilter(*this);
 	}
 
-	virtual CodewordList get_canonical_guesses(
-		CodewordConstRange candidates) const
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange candidates,
+		CodewordIndexList &subset) const
 	{
-#if 0 // MSVC produces slow code if this block is used
-		CodewordList canonical;
-		if (e.rules().repeatable())
-			canonical = filter_rep(candidates);
-		else
-			canonical = filter_norep(candidates);
-		return canonical;
-#else
 		if (e->rules().repeatable())
-			return filter_rep(candidates);
+			filter_rep(candidates, subset);
 		else
-			return filter_norep(candidates);
-#endif
+			filter_norep(candidates, subset);
 	}
 
 	virtual void add_constraint(
@@ -57,121 +51,101 @@ public:
 		_unguessed.reset(e->colorMask(guess));
 		_unguessed.reset(_excluded);
 	}
+
+	virtual void append_state_key(std::string &key) const
+	{
+		// Only the excluded colors affect the canonical guesses.
+		ColorMask::value_type excluded = _excluded.value();
+		key.append((const char *)&excluded, sizeof(excluded));
+	}
 };
 
-CodewordList ColorEquivalenceFilter::filter_rep(
-	CodewordConstRange candidates) const
+// Returns the colors of a guess that are excluded. The colors present in
+// a codeword are read from its color counters with a SIMD comparison
+// (see Engine::colorMask()), so no peg is visited.
+static inline unsigned int excluded_colors(
+	const Engine *e, const Codeword &guess, unsigned int excluded)
+{
+	return e->colorMask(guess).value() & excluded;
+}
+
+void ColorEquivalenceFilter::filter_rep(
+	CodewordConstRange candidates,
+	CodewordIndexList &subset) const
 {
 	// For codewords with repeated colors, we only apply color equivalence
-	// on excluded colors.
+	// on excluded colors. A canonical guess contains no excluded color
+	// other than the smallest one.
 	if (_excluded.empty())
-		return CodewordList(candidates.begin(), candidates.end());
+		return;
 
-	int first = _excluded.smallest();
+	const unsigned int excluded = _excluded.value();
+	const unsigned int others = excluded & (excluded - 1);
 
-	// Find out the minimum equivalent codeword of each codeword. If it is
-	// equal to the codeword itself, keep it.
-	CodewordList canonical;
-	canonical.reserve(candidates.size());
-	for (CodewordConstIterator it = candidates.begin(); it != candidates.end(); ++it)
+	// Keep the canonical candidates by stream compaction: each index is
+	// written to the next slot, which is only advanced if it is kept.
+	const size_t n = subset.size();
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
 	{
-		Codeword guess = *it;
-		bool ok = true;
-		for (int j = 0; j < e->rules().pegs(); j++)
-		{
-			int c = guess[j];
-			if (_excluded[c] && c > first)
-			{
-				ok = false;
-				break;
-			}
-		}
-		if (ok)
-		{
-			canonical.push_back(guess);
-		}
+		const uint32_t index = subset[i];
+		subset[count] = index;
+		count += (excluded_colors(e, candidates[index], others) == 0);
 	}
-	return canonical;
+	subset.resize(count);
 }
 
-// @todo
-// 1) clean up the code
-// 2) we might use SSE2 to speed up part of the code
-CodewordList ColorEquivalenceFilter::filter_norep(
-	CodewordConstRange candidates) const
+void ColorEquivalenceFilter::filter_norep(
+	CodewordConstRange candidates,
+	CodewordIndexList &subset) const
 {
-	// For each codeword without repetition, we check the color on each peg
-	// in turn. If the color is excluded, it must be the smallest excluded
-	// color, otherwise it is not canonical.
+	// For each codeword without repetition, the excluded colors it contains
+	// must be the smallest excluded colors, and must appear on the pegs in
+	// increasing order; otherwise a permutation of the excluded colors maps
+	// it to a smaller codeword.
 	if (_excluded.empty_or_unique())
-		return CodewordList(candidates.begin(), candidates.end());
+		return;
 
-	// Find out the minimum equivalent codeword of each codeword. If it is
-	// equal to the codeword itself, keep it.
-	CodewordList canonical;
-	canonical.reserve(candidates.size());
-	for (CodewordConstIterator it = candidates.begin(); it != candidates.end(); ++it)
+	const unsigned int excluded = _excluded.value();
+	const size_t n = subset.size();
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
 	{
-		Codeword guess = *it;
-
-#if 0 // insignificant optimization
-		// Add the candidate directly if it doesn't contain any excluded colors.
-		if (!(e.colorMask(guess) & _excluded))
-		{
-			canonical.push_back(guess);
-			continue;
-		}
-#endif
+		const uint32_t index = subset[i];
+		const Codeword &guess = candidates[index];
+		const unsigned int present = excluded_colors(e, guess, excluded);
 
-#if 0
-		ColorMask unguessed = _unguessed;
-#endif
-		ColorMask excluded = _excluded;
-		bool ok = true;
+		// The colors present must be the smallest excluded colors, i.e.
+		// each excluded color absent must be larger than all of them.
+		const unsigned int absent = excluded & ~present;
+		bool ok = (absent & (0u - absent)) > present || absent == 0;
 
-		for (int j = 0; j < e->rules().pegs(); j++)
+		// With two or more excluded colors present, check their order.
+		if (ok && (present & (present - 1)) != 0)
 		{
-			int c = guess[j];
-			if (excluded[c])
-			{
-				if ((excluded.value() & ((1 << c) - 1)) != 0)
-				{
-					ok = false;
-					break;
-				}
-				excluded.reset(c);
-
-#if 0 // insignificant optimization
-				if (!excluded)
-					break;
-#endif
-			}
-#if 0
-			if (unguessed[c])
+			int last = -1;
+			for (int j = 0; j < e->rules().pegs() && ok; j++)
 			{
-				if ((unguessed.value() & ((1 << c) - 1)) != 0)
+				int c = guess[j];
+				if (present & (1u << c))
 				{
-					ok = false;
-					break;
+					ok = (c > last);
+					last = c;
 				}
-				unguessed.reset(c);
 			}
-#endif
-		}
-		if (ok)
-		{
-			canonical.push_back(guess);
 		}
+
+		subset[count] = index;
+		count += ok;
 	}
+	subset.resize(count);
 
 #if 1
-	UPDATE_CALL_COUNTER("ColorEquivalence_Input", candidates.size());
-	UPDATE_CALL_COUNTER("ColorEquivalence_Output", canonical.size());
-	UPDATE_CALL_COUNTER("ColorEquivalence_Reduction", candidates.size() - canonical.size());
+	UPDATE_CALL_COUNTER("ColorEquivalence_Input", n);
+	UPDATE_CALL_COUNTER("ColorEquivalence_Output", count);
+	UPDATE_CALL_COUNTER("ColorEquivalence_Reduction", n - count);
 	//UPDATE_CALL_COUNTER("ColorEquivalence_WaysToPermute", pp.size());
 #endif
-
-	return canonical;
 }
 
 EquivalenceFilter* CreateColorEquivalenceFilter(const Engine *e)
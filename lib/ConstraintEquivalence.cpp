@@ -1,7 +1,9 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <memory>
 #include <algorithm>
+#include <numeric>
 
 #include "Engine.hpp"
 #include "Permutation.hpp"
@@ -10,6 +12,19 @@
 #include "util/intrinsic.hpp"
 #include "util/call_counter.hpp"
 #include "util/bitmask.hpp"
+#include "util/simd.hpp"
+
+/// Define the following macro to 1 to test 16 candidates at a time with
+/// SIMD instructions, which requires SSSE3 for the byte shuffles that map
+/// the colors. Otherwise, each candidate is tested by a scalar loop. Both
+/// produce the same canonical guesses.
+#ifndef CONSTRAINT_EQUIVALENCE_SHUFFLE
+#if defined(__SSSE3__)
+#define CONSTRAINT_EQUIVALENCE_SHUFFLE 1
+#else
+#define CONSTRAINT_EQUIVALENCE_SHUFFLE 0
+#endif
+#endif
 
 namespace Mastermind {
 
@@ -19,7 +34,19 @@ class ConstraintEquivalenceFilter : public EquivalenceFilter
 	const Engine *e;
 	ColorMask free_colors;
 
-	std::vector<	CodewordPermutation> pp;
+	// Peg permutations left, each with its partial color permutation. The
+	// list is shared by the copies of the filter and is replaced rather
+	// than modified, so that cloning the filter does not copy it.
+	typedef std::vector<CodewordPermutation> PermutationList;
+	std::shared_ptr<const PermutationList> pp;
+
+	bool is_canonical(const Codeword &candidate) const;
+	void restrict_permutations(const Codeword &guess);
+
+#if CONSTRAINT_EQUIVALENCE_SHUFFLE
+	void filter_blocks(CodewordConstRange candidates,
+		CodewordIndexList &subset) const;
+#endif
 
 public:
 
@@ -30,14 +57,17 @@ public:
 		return new ConstraintEquivalenceFilter(*this);
 	}
 
-	virtual CodewordList get_canonical_guesses(
-		CodewordConstRange candidates) const;
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange candidates,
+		CodewordIndexList &subset) const;
 
 	virtual void add_constraint(
 		const Codeword &guess,
 		Feedback response,
 		CodewordConstRange remaining
 		);
+
+	virtual void append_state_key(std::string &key) const;
 };
 
 /// Initializes a constraint equivalence filter.
@@ -46,17 +76,91 @@ ConstraintEquivalenceFilter::ConstraintEquivalenceFilter(const Engine *engine)
 {
 	// Generate all peg permutations, and associate with each peg
 	// permutation a fully unrestricted partial color permutation.
+	std::shared_ptr<PermutationList> all = std::make_shared<PermutationList>();
+	// The pegs are permuted in a local array whose bound the compiler can
+	// see, then copied into the stored permutation.
+	const int npegs = std::min(e->rules().pegs(), MM_MAX_PEGS);
+	int perm[MM_MAX_PEGS];
+	std::iota(perm + 0, perm + npegs, 0);
 	CodewordPermutation p;
 	do
 	{
-		pp.push_back(p);
+		for (int i = 0; i < npegs; ++i)
+			p.peg[i] = (int8_t)perm[i];
+		all->push_back(p);
 	}
-	while (std::next_permutation(p.peg + 0, p.peg + e->rules().pegs()));
+	while (std::next_permutation(perm + 0, perm + npegs));
+	pp = all;
 }
 
-// Returns a list of canonical guesses given the current constraints.
-CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
-	CodewordConstRange candidates) const
+// Tests whether a candidate is canonical, i.e. whether no permutation
+// maps it to a lexicographically smaller codeword.
+bool ConstraintEquivalenceFilter::is_canonical(const Codeword &candidate) const
+{
+	bool is_canonical = true;
+
+	// Check each peg permutation to see if there exists a peg/color
+	// permutation that maps the candidate to a lexicographically
+	// smaller equivalent codeword.
+	for (size_t j = 0; j < pp->size(); ++j)
+	{
+		// Permute the pegs and colors of the candidate.
+		// Free colors are kept unchanged.
+		// Optimization: if this is the identity permutation,
+		// then needn't permute.
+		CodewordPermutation p = (*pp)[j];
+		Codeword permuted_candidate =
+			(j == 0)? candidate : p.permute_pegs(candidate);
+
+		// Check the color on each peg in turn.
+		// Take, for example, 1223. It must be able to map to 1123 and
+		// show that it's not canonical.
+		ColorMask free_from = free_colors, free_to = free_colors;
+		for (int k = 0; k < e->rules().pegs(); ++k)
+		{
+			// Let c be the color on peg k of the peg-permuted candidate.
+			int c = permuted_candidate[k];
+
+			// If c is free, map it to the smallest available free color,
+			// and update the permutation. Otherwise, map it according
+			// to the current permutation.
+			if (free_from[c])
+			{
+				// Find the smallest available free color.
+				int cc = free_to.smallest();
+
+				// Map c to cc.
+				p.color[c] = (char)cc;
+
+				// Clear the respective free-color indicator.
+				free_from.reset(c);
+				free_to.reset(cc);
+			}
+			c = p.color[c];
+
+			// The mapped color, c, must be lexicographically greater
+			// than or equal to the corresponding color in the candidate
+			// for the candidate to be canonical.
+			if (c < candidate[k])
+			{
+				is_canonical = false;
+				break;
+			}
+			else if (c > candidate[k])
+			{
+				break;
+			}
+		}
+		if (!is_canonical)
+			break;
+	}
+	return is_canonical;
+}
+
+// Keeps the canonical guesses given the current constraints.
+void ConstraintEquivalenceFilter::narrow_canonical_guesses(
+	CodewordConstRange candidates,
+	CodewordIndexList &subset) const
 {
 	// const bool verbose = false;
 
@@ -65,89 +169,157 @@ CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
 	// which case it must be the identity permutation) and there are
 	// no free colors left, then the color permutation must be
 	// identity too, and there is no codeword to filter out.
-	if (pp.size() == 1 && free_colors.empty())
-		return CodewordList(candidates.begin(), candidates.end());
+	if (pp->size() == 1 && free_colors.empty())
+		return;
 #endif
 
 	// Check each candidate in turn.
-	size_t n = candidates.size();
-	CodewordList canonical;
-	canonical.reserve(n);
+	const size_t n = subset.size();
+#if CONSTRAINT_EQUIVALENCE_SHUFFLE
+	filter_blocks(candidates, subset);
+#else
+	size_t count = 0;
 	for (size_t i = 0; i < n; ++i)
 	{
-		const Codeword candidate = candidates.begin()[i];
-		bool is_canonical = true;
+		const uint32_t index = subset[i];
+		subset[count] = index;
+		count += is_canonical(candidates[index]);
+	}
+	subset.resize(count);
+#endif
 
-		// Check each peg permutation to see if there exists a peg/color
-		// permutation that maps the candidate to a lexicographically
-		// smaller equivalent codeword.
-		for (size_t j = 0; j < pp.size(); ++j)
-		{
-			// Permute the pegs and colors of the candidate.
-			// Free colors are kept unchanged.
-			// Optimization: if this is the identity permutation,
-			// then needn't permute.
-			CodewordPermutation p = pp[j];
-			Codeword permuted_candidate =
-				(j == 0)? candidate : p.permute_pegs(candidate);
-
-			// Check the color on each peg in turn.
-			// Take, for example, 1223. It must be able to map to 1123 and
-			// show that it's not canonical.
-			ColorMask free_from = free_colors, free_to = free_colors;
-			for (int k = 0; k < e->rules().pegs(); ++k)
-			{
-				// Let c be the color on peg k of the peg-permuted candidate.
-				int c = permuted_candidate[k];
+#if 1
+	UPDATE_CALL_COUNTER("ConstraintEquivalence_Input", n);
+	UPDATE_CALL_COUNTER("ConstraintEquivalence_Output", subset.size());
+	//UPDATE_CALL_COUNTER("ConstraintEquivalence_WaysToPermute", pp->size());
+	UPDATE_CALL_COUNTER("ConstraintEquivalence_Reduction", n - subset.size());
+#endif
+}
 
-				// If c is free, map it to the smallest available free color,
-				// and update the permutation. Otherwise, map it according
-				// to the current permutation.
-				if (free_from[c])
-				{
-					// Find the smallest available free color.
-					int cc = free_to.smallest();
+#if CONSTRAINT_EQUIVALENCE_SHUFFLE
+// Tests the candidates in blocks of 16 in the same way as is_canonical(),
+// with one candidate in each byte of an XMM register. The digits of the
+// block are transposed so that each register holds one peg, so a peg
+// permutation only selects the registers in a different order. The colors
+// are mapped by byte shuffles with the color table of the permutation,
+// and the i-th distinct free color (in order of first occurrence) is
+// mapped to the i-th smallest free color.
+void ConstraintEquivalenceFilter::filter_blocks(
+	CodewordConstRange candidates,
+	CodewordIndexList &subset) const
+{
+	using util::simd::shuffle;
+	const int npegs = e->rules().pegs();
+
+	// Color table of each permutation. Byte c is the color that the
+	// (fixed) color c is mapped to.
+	std::vector<__m128i, util::aligned_allocator<__m128i,16>> tables(pp->size());
+	for (size_t j = 0; j < pp->size(); ++j)
+	{
+		int8_t colors[16] = { 0 };
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+			colors[c] = (*pp)[j].color[c];
+		tables[j] = _mm_loadu_si128((const __m128i *)colors);
+	}
 
-					// Map c to cc.
-					p.color[c] = (char)cc;
+	// Byte c of 'free' is 0xff if color c is free, and byte i of 'targets'
+	// is the i-th smallest free color.
+	int8_t free_bytes[16] = { 0 }, target_bytes[16] = { 0 };
+	ColorMask free_to = free_colors;
+	for (int i = 0; !free_to.empty(); ++i)
+	{
+		int c = free_to.smallest();
+		free_bytes[c] = -1;
+		target_bytes[i] = (int8_t)c;
+		free_to.reset(c);
+	}
+	const __m128i free = _mm_loadu_si128((const __m128i *)free_bytes);
+	const __m128i targets = _mm_loadu_si128((const __m128i *)target_bytes);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i ones = _mm_set1_epi8(-1);
+
+	// The indices kept are written back to the subset, never past the
+	// block being read.
+	const size_t n = subset.size();
+	size_t kept = 0;
+	for (size_t base = 0; base < n; base += 16)
+	{
+		const int count = (int)std::min(n - base, (size_t)16);
+		const int valid = (1 << count) - 1;
 
-					// Clear the respective free-color indicator.
-					free_from.reset(c);
-					free_to.reset(cc);
-				}
-				c = p.color[c];
+		// Transpose the digits of the block.
+		int8_t bytes[MM_MAX_PEGS][16];
+		for (int l = 0; l < 16; ++l)
+		{
+			const Codeword &w = candidates[subset[base + std::min(l, count - 1)]];
+			for (int k = 0; k < npegs; ++k)
+				bytes[k][l] = (int8_t)w[k];
+		}
+		__m128i digit[MM_MAX_PEGS], is_free[MM_MAX_PEGS];
+		__m128i same[MM_MAX_PEGS][MM_MAX_PEGS];
+		for (int k = 0; k < npegs; ++k)
+		{
+			digit[k] = _mm_loadu_si128((const __m128i *)bytes[k]);
+			is_free[k] = shuffle(free, digit[k]);
+			for (int i = 0; i < k; ++i)
+				same[k][i] = same[i][k] = _mm_cmpeq_epi8(digit[k], digit[i]);
+		}
 
-				// The mapped color, c, must be lexicographically greater
-				// than or equal to the corresponding color in the candidate
-				// for the candidate to be canonical.
-				if (c < candidate[k])
+		int canonical_mask = valid;
+		for (size_t j = 0; j < pp->size() && canonical_mask != 0; ++j)
+		{
+			// Position of the digit moved to each peg.
+			int from[MM_MAX_PEGS];
+			for (int i = 0; i < npegs; ++i)
+				from[(int)(*pp)[j].peg[i]] = i;
+
+			__m128i mapped[MM_MAX_PEGS];
+			__m128i rank = _mm_setzero_si128();
+			__m128i undecided = ones, smaller = _mm_setzero_si128();
+			for (int k = 0; k < npegs; ++k)
+			{
+				const int i = from[k];
+
+				// A color seen on a previous peg keeps its mapping.
+				__m128i repeat = _mm_setzero_si128();
+				__m128i value = _mm_andnot_si128(is_free[i],
+					shuffle(tables[j], digit[i]));
+				for (int r = 0; r < k; ++r)
 				{
-					is_canonical = false;
-					break;
+					const __m128i s = same[i][from[r]];
+					repeat = _mm_or_si128(repeat, s);
+					value = _mm_or_si128(value, _mm_and_si128(s, mapped[r]));
 				}
-				else if (c > candidate[k])
-				{
+
+				// A free color seen for the first time is mapped to the
+				// smallest free color not mapped to yet.
+				const __m128i first = _mm_andnot_si128(repeat, is_free[i]);
+				value = _mm_or_si128(value,
+					_mm_and_si128(first, shuffle(targets, rank)));
+				rank = _mm_add_epi8(rank, _mm_and_si128(first, one));
+				mapped[k] = value;
+
+				// The candidate is not canonical if the first peg where
+				// the mapped codeword differs from it has a smaller color.
+				smaller = _mm_or_si128(smaller, _mm_and_si128(undecided,
+					_mm_cmpgt_epi8(digit[k], value)));
+				undecided = _mm_and_si128(undecided,
+					_mm_cmpeq_epi8(digit[k], value));
+				if ((_mm_movemask_epi8(undecided) & canonical_mask) == 0)
 					break;
-				}
 			}
-			if (!is_canonical)
-				break;
+			canonical_mask &= ~_mm_movemask_epi8(smaller);
 		}
 
-		// Append the candidate to the result if it's canonical.
-		if (is_canonical)
-			canonical.push_back(candidate);
+		for (int l = 0; l < count; ++l)
+		{
+			subset[kept] = subset[base + l];
+			kept += (canonical_mask >> l) & 1;
+		}
 	}
-
-#if 1
-	UPDATE_CALL_COUNTER("ConstraintEquivalence_Input", candidates.size());
-	UPDATE_CALL_COUNTER("ConstraintEquivalence_Output", canonical.size());
-	//UPDATE_CALL_COUNTER("ConstraintEquivalence_WaysToPermute", pp.size());
-	UPDATE_CALL_COUNTER("ConstraintEquivalence_Reduction", candidates.size() - canonical.size());
-#endif
-
-	return canonical;
+	subset.resize(kept);
 }
+#endif
 
 void ConstraintEquivalenceFilter::add_constraint(
 	const Codeword &guess,
@@ -159,14 +331,44 @@ void ConstraintEquivalenceFilter::add_constraint(
 	if (verbose)
 		std::cout << "Adding constraint: " << guess << std::endl;
 
+	// Optimization: if only the identity permutation is left, it maps
+	// the guess onto itself with each color of the guess mapped to itself,
+	// which the identity color permutation already does. This is the case
+	// after a guess or two, and saves copying the list of permutations.
+	if (pp->size() > 1)
+		restrict_permutations(guess);
+
+	// Restrict the color mask.
+	for (int i = 0; i < e->rules().pegs(); ++i)
+	{
+		free_colors.reset(guess[i]);
+	}
+
+	// If all but one colors are restricted, the last color is
+	// automatically restricted because it can only map to itself.
+	if (free_colors.unique())
+		free_colors.reset();
+
+	// After a few constraints, only the identity permutation
+	// will remain.
+}
+
+void ConstraintEquivalenceFilter::restrict_permutations(const Codeword &guess)
+{
+	bool verbose = false;
+
 	// For each peg permutation, restrict its associated partial
 	// color permutation so that the supplied guess maps to itself
 	// under the peg+color permutation. If this is not possible,
-	// remove the peg permutation from the list.
-	for (size_t i = pp.size(); i > 0; )
+	// remove the peg permutation from the list. The list is shared
+	// with the filter this one is cloned from, so it is copied first.
+	std::shared_ptr<PermutationList> restricted =
+		std::make_shared<PermutationList>(*pp);
+	PermutationList &perms = *restricted;
+	for (size_t i = perms.size(); i > 0; )
 	{
 		--i;
-		CodewordPermutation &p = pp[i];
+		CodewordPermutation &p = perms[i];
 
 		// Permute the pegs in the guess.
 		Codeword permuted = p.permute_pegs(guess);
@@ -198,32 +400,41 @@ void ConstraintEquivalenceFilter::add_constraint(
 		if (!ok)
 		{
 			if (verbose)
-				std::cout << "Removed peg permutation: " << pp[i] << std::endl;
+				std::cout << "Removed peg permutation: " << perms[i] << std::endl;
 
-			std::swap(pp[i], pp[pp.size()-1]);
-			pp.erase(pp.begin() + pp.size() - 1);
+			std::swap(perms[i], perms[perms.size()-1]);
+			perms.erase(perms.begin() + perms.size() - 1);
 		}
 		else
 		{
 			if (verbose)
 				std::cout << "Restricted peg permutation: "
-					<< pp[i] << std::endl;
+					<< perms[i] << std::endl;
 		}
 	}
 
-	// Restrict the color mask.
-	for (int i = 0; i < e->rules().pegs(); ++i)
+	pp = restricted;
+}
+
+// The key lists the free colors and the peg permutations left, each with
+// the colors it maps the restricted colors to. The colors that free colors
+// map to are not part of the state, as they are chosen for each candidate.
+void ConstraintEquivalenceFilter::append_state_key(std::string &key) const
+{
+	const int p = e->rules().pegs(), c = e->rules().colors();
+	ColorMask::value_type free = free_colors.value();
+	uint32_t n = (uint32_t)pp->size();
+	key.append((const char *)&free, sizeof(free));
+	key.append((const char *)&n, sizeof(n));
+	for (size_t j = 0; j < pp->size(); ++j)
 	{
-		free_colors.reset(guess[i]);
+		key.append((const char *)(*pp)[j].peg, p);
+		for (int x = 0; x < c; ++x)
+		{
+			if (!free_colors[x])
+				key.push_back((char)(*pp)[j].color[x]);
+		}
 	}
-
-	// If all but one colors are restricted, the last color is
-	// automatically restricted because it can only map to itself.
-	if (free_colors.unique())
-		free_colors.reset();
-
-	// After a few constraints, only the identity permutation
-	// will remain.
 }
 
 EquivalenceFilter* CreateConstraintEquivalenceFilter(const Engine *e)
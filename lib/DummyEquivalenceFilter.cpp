@@ -19,12 +19,23 @@ public:
 		return CodewordList(candidates.begin(), candidates.end());
 	}
 
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange /* candidates */,
+		CodewordIndexList & /* subset */
+		) const
+	{
+	}
+
 	virtual void add_constraint(
 		const Codeword & /* guess */,
 		Feedback /* response */, 
 		CodewordConstRange /* remaining */)
 	{
 	}
+
+	virtual void append_state_key(std::string & /* key */) const
+	{
+	}
 };
 
 EquivalenceFilter* CreateDummyEquivalenceFilter(const Engine *)
@@ -36,7 +36,24 @@ CodewordPartition Engine::partition(
 
 	// Compare the guess to each codeword in the list.
 	FeedbackList fbl;
-	FeedbackFrequencyTable freq = compare(guess, codewords, fbl);
+	compare(guess, codewords, fbl);
+	return partition(codewords, fbl);
+}
+
+CodewordPartition Engine::partition(
+	CodewordRange codewords,
+	FeedbackList &fbl) const
+{
+	assert(fbl.size() == codewords.size());
+
+	// If there's no element in the list, do nothing.
+	if (codewords.empty())
+		return CodewordPartition();
+
+	// Count the codewords in each partition.
+	FeedbackFrequencyTable freq(Feedback::size(rules()));
+	for (size_t i = 0; i < fbl.size(); ++i)
+		++freq[fbl[i].value()];
 
 	// Build a table to store the range of each partition.
 	struct partition_location
@@ -155,6 +155,15 @@ public:
 		CodewordRange codewords, 
 		const Codeword &guess) const;
 
+	/// Partitions a list of codewords by their responses to a guess that
+	/// have already been computed, such as by <code>compare()</code>. The
+	/// feedbacks are reordered together with the codewords.
+	/// <param name="codewords">List of codewords to partition.</param>
+	/// <param name="feedbacks">Response of each codeword to the guess.</param>
+	CodewordPartition partition(
+		CodewordRange codewords,
+		FeedbackList &feedbacks) const;
+
 	/// Returns a bit-mask of the colors that are present in the codeword.
 	ColorMask colorMask(const Codeword &c) const
 	{
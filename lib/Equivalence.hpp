@@ -1,11 +1,20 @@
 #ifndef MASTERMIND_EQUIVALENCE_HPP
 #define MASTERMIND_EQUIVALENCE_HPP
 
+#include <cstdint>
 #include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
 #include "Engine.hpp"
 
 namespace Mastermind {
 
+/// List of the indices of a subset of codewords in a list, in increasing
+/// order.
+/// @ingroup equiv
+typedef std::vector<uint32_t> CodewordIndexList;
+
 /// Defines an interface for an equivalence filter that filters canonical 
 /// guesses from a set of candidate codewords. 
 /// @ingroup equiv
@@ -19,8 +28,30 @@ struct EquivalenceFilter
 	virtual EquivalenceFilter* clone() const = 0;
 
 	/// Returns a list of canonical guesses from a set of candidates.
+	/// The default implementation narrows the subset of all candidates
+	/// (see narrow_canonical_guesses()) and copies the guesses kept.
 	virtual CodewordList get_canonical_guesses(
 		CodewordConstRange candidates
+		) const
+	{
+		CodewordIndexList subset(candidates.size());
+		std::iota(subset.begin(), subset.end(), 0);
+		narrow_canonical_guesses(candidates, subset);
+
+		CodewordList canonical(subset.size());
+		for (size_t i = 0; i < subset.size(); ++i)
+			canonical[i] = candidates[subset[i]];
+		return canonical;
+	}
+
+	/// Narrows a subset of candidates to the canonical guesses in it, in
+	/// place. @c subset holds the indices of the subset in @c candidates;
+	/// the indices of the guesses that are not canonical are removed from
+	/// it, and the others are kept in order. No codeword is copied, so
+	/// filters may be chained on the same subset.
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange candidates,
+		CodewordIndexList &subset
 		) const = 0;
 
 	/// Adds a constraint to the current state.
@@ -29,6 +60,12 @@ struct EquivalenceFilter
 		Feedback response, 
 		CodewordConstRange remaining
 		) = 0;
+
+	/// Appends to @c key a compact key of the current state. Two filters
+	/// of the same type whose keys are equal return the same canonical
+	/// guesses from the same candidates. The key tells its own length,
+	/// so that the keys of chained filters may be concatenated.
+	virtual void append_state_key(std::string &key) const = 0;
 };
 
 /// Typedef of pointer to function that creates an equivalence filter.
@@ -38,6 +75,7 @@ struct EquivalenceFilter
 extern EquivalenceFilter* CreateDummyEquivalenceFilter(const Engine *e);
 extern EquivalenceFilter* CreateColorEquivalenceFilter(const Engine *e);
 extern EquivalenceFilter* CreateConstraintEquivalenceFilter(const Engine *e);
+extern EquivalenceFilter* CreateSymmetryEquivalenceFilter(const Engine *e);
 
 /// Composite equivalence filter which chains two underlying filters.
 /// @ingroup equiv
@@ -73,12 +111,13 @@ public:
 		return new CompositeEquivalenceFilter(_filter1.get(), _filter2.get());
 	}
 
-	virtual CodewordList get_canonical_guesses(
-		CodewordConstRange candidates
-		) const 
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange candidates,
+		CodewordIndexList &subset
+		) const
 	{
-		CodewordList temp = _filter1->get_canonical_guesses(candidates);
-		return _filter2->get_canonical_guesses(temp);
+		_filter1->narrow_canonical_guesses(candidates, subset);
+		_filter2->narrow_canonical_guesses(candidates, subset);
 	}
 
 	virtual void add_constraint(
@@ -90,6 +129,12 @@ public:
 		_filter2->add_constraint(guess, response, remaining);
 	}
 
+	virtual void append_state_key(std::string &key) const
+	{
+		_filter1->append_state_key(key);
+		_filter2->append_state_key(key);
+	}
+
 	/// Returns the first filter.
 	const EquivalenceFilter* first() const { return _filter1.get(); }
 
@@ -1,6 +1,8 @@
 #ifndef MASTERMIND_HEURISTIC_STRATEGY_HPP
 #define MASTERMIND_HEURISTIC_STRATEGY_HPP
 
+#include <vector>
+#include <algorithm>
 #include "Strategy.hpp"
 #include "util/call_counter.hpp"
 
@@ -22,6 +24,32 @@
 
 namespace Mastermind {
 
+/// Converts a heuristic score to a scalar value, which is reported in a
+/// <code>RankedGuess</code>. This generic version works for any score
+/// type that is convertible to <code>double</code>.
+/// @ingroup Heuristic
+template <class Score>
+inline double heuristic_score_value(const Score &score)
+{
+	return static_cast<double>(score);
+}
+
+/// Converts a min-max score to a scalar value, which is the size of the
+/// largest cell.
+/// @ingroup Heuristic
+inline double heuristic_score_value(const FeedbackFrequencyTable &score)
+{
+	return score.size() > 0 ? score[0] : 0.0;
+}
+
+/// Converts a lower-bound score to a scalar value, which is the total
+/// number of steps.
+/// @ingroup Heuristic
+inline double heuristic_score_value(const StrategyCost &score)
+{
+	return score.steps;
+}
+
 /// <summary>
 /// Type of a function object that takes as input the partitioning of 
 /// remaining possibilities and returns as output a heuristic score.
@@ -260,6 +288,52 @@ public:
 		return candidates[choice.i];
 #endif
 	}
+
+	/// Ranks the candidates by their heuristic score and returns the
+	/// @c k best ones. All candidates are scored in a single (parallel)
+	/// pass. Ties are broken in the same way as <code>make_guess()</code>.
+	virtual RankedGuessList rank_guesses(
+		CodewordConstRange possibilities,
+		CodewordConstRange candidates,
+		size_t k) const
+	{
+		UPDATE_CALL_COUNTER("EvaluateHeuristic_Possibilities", (unsigned int)possibilities.size());
+		UPDATE_CALL_COUNTER("EvaluateHeuristic_Candidates", (unsigned int)candidates.size());
+
+#if FAVOR_POSSIBILITY
+		size_t target = Feedback::perfectValue(e->rules()).value();
+#endif
+
+		int n = (int)candidates.size();
+		std::vector<choice_t> choices(n);
+
+#if _OPENMP
+		// OpenMP index variable (i) must have signed integer type.
+		#pragma omp parallel for schedule(static)
+#endif
+		for (int i = 0; i < n; ++i)
+		{
+			FeedbackFrequencyTable freq = e->compare(candidates[i], possibilities);
+#if FAVOR_POSSIBILITY
+			choices[i] = choice_t(i, h.compute(freq), freq[target] > 0);
+#else
+			choices[i] = choice_t(i, h.compute(freq));
+#endif
+		}
+
+		// Only sort the top k choices.
+		size_t m = std::min(k, choices.size());
+		std::partial_sort(choices.begin(), choices.begin() + m, choices.end());
+
+		RankedGuessList ranks;
+		ranks.reserve(m);
+		for (size_t j = 0; j < m; ++j)
+		{
+			ranks.push_back(RankedGuess(candidates[choices[j].i],
+				heuristic_score_value(choices[j].score)));
+		}
+		return ranks;
+	}
 };
 
 } // namespace Mastermind
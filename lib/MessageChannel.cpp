@@ -0,0 +1,302 @@
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "MessageChannel.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace Mastermind {
+
+#ifndef _WIN32
+
+namespace {
+
+/// Socket address parsed from the text form of an address.
+struct SocketAddress
+{
+	int family;
+	std::string path;
+	std::string host;
+	std::string port;
+
+	explicit SocketAddress(const std::string &address)
+	{
+		if (address.compare(0, 5, "unix:") == 0)
+		{
+			family = AF_UNIX;
+			path = address.substr(5);
+			if (path.empty() || path.size() >= sizeof(((sockaddr_un *)0)->sun_path))
+				throw std::runtime_error("invalid socket path: " + path);
+		}
+		else
+		{
+			size_t colon = address.rfind(':');
+			if (colon == std::string::npos || colon + 1 == address.size())
+				throw std::runtime_error("invalid address: " + address);
+			family = AF_INET;
+			host = address.substr(0, colon);
+			port = address.substr(colon + 1);
+		}
+	}
+
+	/// Creates a socket and binds or connects it to the address. Returns
+	/// -1 if the operation fails.
+	int open(bool server) const
+	{
+		if (family == AF_UNIX)
+		{
+			sockaddr_un sa;
+			std::memset(&sa, 0, sizeof(sa));
+			sa.sun_family = AF_UNIX;
+			std::strcpy(sa.sun_path, path.c_str());
+			int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0)
+				return -1;
+			int ret = server? bind(fd, (sockaddr *)&sa, sizeof(sa)) :
+				connect(fd, (sockaddr *)&sa, sizeof(sa));
+			if (ret != 0)
+			{
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+
+		addrinfo hints, *list;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = server? AI_PASSIVE : 0;
+		if (getaddrinfo(host.empty()? NULL : host.c_str(), port.c_str(),
+			&hints, &list) != 0)
+			return -1;
+		int fd = -1;
+		for (addrinfo *ai = list; ai != NULL && fd < 0; ai = ai->ai_next)
+		{
+			fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (fd < 0)
+				continue;
+			int ret;
+			if (server)
+			{
+				int on = 1;
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+				ret = bind(fd, ai->ai_addr, ai->ai_addrlen);
+			}
+			else
+			{
+				ret = connect(fd, ai->ai_addr, ai->ai_addrlen);
+			}
+			if (ret != 0)
+			{
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(list);
+		return fd;
+	}
+};
+
+} // anonymous namespace
+
+MessageChannel::MessageChannel(const std::string &address, double timeout)
+	: _fd(-1)
+{
+	SocketAddress sa(address);
+
+	// Retry every 50 ms until the coordinator is listening.
+	for (int attempt = 0; (_fd = sa.open(false)) < 0; ++attempt)
+	{
+		if (attempt * 0.05 >= timeout)
+			throw std::runtime_error("cannot connect to " + address);
+		timespec ts = { 0, 50000000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+MessageChannel::~MessageChannel()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+bool MessageChannel::send(const std::string &message)
+{
+	std::ostringstream os;
+	os << message.size() << '\n' << message;
+	std::string data = os.str();
+	for (size_t sent = 0; sent < data.size(); )
+	{
+		ssize_t n = ::send(_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		sent += (size_t)n;
+	}
+	return true;
+}
+
+/// Reads the data available on the socket into the input buffer, waiting
+/// until some arrives. Returns @c false if the connection is closed.
+bool MessageChannel::fill()
+{
+	char buffer[4096];
+	ssize_t n;
+	do
+	{
+		n = recv(_fd, buffer, sizeof(buffer), 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return false;
+	_input.append(buffer, (size_t)n);
+	return true;
+}
+
+bool MessageChannel::pending() const
+{
+	size_t eol = _input.find('\n');
+	return eol != std::string::npos &&
+		_input.size() - eol - 1 >= (size_t)std::strtoul(_input.c_str(), NULL, 10);
+}
+
+bool MessageChannel::receive(std::string &message)
+{
+	while (!pending())
+	{
+		if (!fill())
+			return false;
+	}
+	size_t eol = _input.find('\n');
+	size_t length = (size_t)std::strtoul(_input.c_str(), NULL, 10);
+	message = _input.substr(eol + 1, length);
+	_input.erase(0, eol + 1 + length);
+	return true;
+}
+
+size_t MessageChannel::wait(const std::vector<MessageChannel *> &channels)
+{
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		if (channels[i]->pending())
+			return i;
+	}
+
+	std::vector<pollfd> fds(channels.size());
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		fds[i].fd = channels[i]->_fd;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	for (;;)
+	{
+		int n = poll(fds.data(), (nfds_t)fds.size(), -1);
+		if (n < 0 && errno != EINTR)
+			throw std::runtime_error("cannot wait for messages");
+		for (size_t i = 0; n > 0 && i < fds.size(); ++i)
+		{
+			if (fds[i].revents != 0)
+				return i;
+		}
+	}
+}
+
+MessageListener::MessageListener(const std::string &address) : _fd(-1)
+{
+	SocketAddress sa(address);
+	if (sa.family == AF_UNIX)
+	{
+		// Remove the socket file left by a previous coordinator.
+		unlink(sa.path.c_str());
+		_path = sa.path;
+	}
+	_fd = sa.open(true);
+	if (_fd < 0 || listen(_fd, 64) != 0)
+		throw std::runtime_error("cannot listen on " + address);
+}
+
+MessageListener::~MessageListener()
+{
+	if (_fd >= 0)
+		close(_fd);
+	if (!_path.empty())
+		unlink(_path.c_str());
+}
+
+MessageChannel * MessageListener::accept(double timeout)
+{
+	pollfd pfd;
+	pfd.fd = _fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int n;
+	do
+	{
+		n = poll(&pfd, 1, (int)(timeout * 1000));
+	} while (n < 0 && errno == EINTR);
+	if (n < 0)
+		throw std::runtime_error("cannot accept connection");
+	if (n == 0)
+		return NULL;
+
+	int fd;
+	do
+	{
+		fd = ::accept(_fd, NULL, NULL);
+	} while (fd < 0 && errno == EINTR);
+	if (fd < 0)
+		throw std::runtime_error("cannot accept connection");
+	return new MessageChannel(fd);
+}
+
+#else
+
+MessageChannel::MessageChannel(const std::string &, double) : _fd(-1)
+{
+	throw std::runtime_error("sockets are not supported on this platform");
+}
+
+MessageChannel::~MessageChannel() { }
+
+bool MessageChannel::send(const std::string &) { return false; }
+
+bool MessageChannel::fill() { return false; }
+
+bool MessageChannel::pending() const { return false; }
+
+bool MessageChannel::receive(std::string &) { return false; }
+
+size_t MessageChannel::wait(const std::vector<MessageChannel *> &)
+{
+	throw std::runtime_error("sockets are not supported on this platform");
+}
+
+MessageListener::MessageListener(const std::string &) : _fd(-1)
+{
+	throw std::runtime_error("sockets are not supported on this platform");
+}
+
+MessageListener::~MessageListener() { }
+
+MessageChannel * MessageListener::accept(double) { return NULL; }
+
+#endif
+
+} // namespace Mastermind
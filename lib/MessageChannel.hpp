@@ -0,0 +1,87 @@
+#ifndef MASTERMIND_MESSAGE_CHANNEL_HPP
+#define MASTERMIND_MESSAGE_CHANNEL_HPP
+
+#include <string>
+#include <vector>
+
+namespace Mastermind {
+
+/**
+ * Connection over a stream socket that carries text messages in both
+ * directions, used by the processes of a distributed search.
+ *
+ * An address is either <code>unix:path</code> for a Unix domain socket,
+ * or <code>host:port</code> for a TCP socket. Each message is sent as its
+ * length on a line followed by its content, so a message may span lines.
+ * The functions throw <code>std::runtime_error</code> if the connection
+ * cannot be established. Sockets are only supported on POSIX systems.
+ *
+ * @ingroup Optimal
+ */
+class MessageChannel
+{
+	int _fd;
+	std::string _input;
+
+	MessageChannel(const MessageChannel &);
+	MessageChannel& operator = (const MessageChannel &);
+
+	bool fill();
+
+public:
+
+	/// Wraps a connected socket.
+	explicit MessageChannel(int fd) : _fd(fd) { }
+
+	/// Connects to the given address. If nothing listens on the address
+	/// yet, retries for up to @c timeout seconds.
+	MessageChannel(const std::string &address, double timeout);
+
+	/// Closes the connection.
+	~MessageChannel();
+
+	/// Sends a message. Returns @c false if the connection is closed.
+	bool send(const std::string &message);
+
+	/// Receives a message, waiting until it arrives. Returns @c false if
+	/// the connection is closed.
+	bool receive(std::string &message);
+
+	/// Tests whether a complete message has been received and not yet
+	/// read by <code>receive()</code>.
+	bool pending() const;
+
+	/// Waits until one of the given channels has a message to receive or
+	/// is closed, and returns its index.
+	static size_t wait(const std::vector<MessageChannel *> &channels);
+};
+
+/// Socket that accepts connections on an address. See @c MessageChannel
+/// for the format of an address.
+/// @ingroup Optimal
+class MessageListener
+{
+	int _fd;
+	std::string _path;
+
+	MessageListener(const MessageListener &);
+	MessageListener& operator = (const MessageListener &);
+
+public:
+
+	/// Listens on the given address.
+	explicit MessageListener(const std::string &address);
+
+	/// Stops listening, and removes the socket file of a Unix domain
+	/// socket.
+	~MessageListener();
+
+	/// Waits up to @c timeout seconds for a connection and returns the
+	/// channel connected to it, or @c NULL if none arrives in time. The
+	/// caller owns the channel.
+	MessageChannel * accept(double timeout);
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_MESSAGE_CHANNEL_HPP
@@ -110,6 +110,48 @@ StrategyCost estimate_obvious_lowerbound(
 		(unsigned short)(extra > 0 ? extra : n)); // worst count
 }
 
+/**
+ * Estimates an upper bound of the number of distinct feedbacks, other than
+ * the perfect match, that any guess can produce against a set of remaining
+ * possibilities. The returned bound is no larger than @c max_b; the
+ * estimation stops as soon as this limit is reached.
+ *
+ * The possibilities that contain the same colors have the same number of
+ * common colors with any guess, say @c k, so their feedbacks all have
+ * <code>k</code> pegs in total. Apart from the perfect match, there are
+ * at most @c p such feedbacks. Therefore a group of @c m possibilities
+ * that contain the same colors produces at most <code>min(m,p)</code>
+ * distinct feedbacks, whatever the guess is.
+ */
+int estimate_max_branching(
+	const Rules &rules,
+	CodewordConstRange possibilities,
+	int max_b)
+{
+	const int M = MM_MAX_PEGS * (MM_MAX_PEGS + 3) / 2;
+	assert(max_b < M);
+
+	int p = rules.pegs();
+	const Codeword *group[M];
+	int size[M];
+	int ngroup = 0, total = 0;
+	for (size_t i = 0; i < possibilities.size(); ++i)
+	{
+		const Codeword &secret = possibilities[i];
+		int k = 0;
+		while (k < ngroup && !contain_same_colors(secret, *group[k]))
+			++k;
+		if (k == ngroup)
+		{
+			group[ngroup] = &secret;
+			size[ngroup++] = 0;
+		}
+		if (++size[k] <= p && ++total >= max_b)
+			return max_b;
+	}
+	return total;
+}
+
 /**
  * Returns an obviously-optimal guess if one exists.
  * We will only make a guess from the list of remaining possibilities.
@@ -228,6 +270,11 @@ Codeword make_obvious_guess(
 	if (best_extra < 0)
 		return Codeword();
 
+	// A cell with two secrets takes a third guess to reveal one of them.
+	// If that's not allowed, return.
+	if (max_depth < 3)
+		return Codeword();
+
 	// Update the cost.
 	cost = StrategyCost(2*count-1+best_extra, 3, 1);
 
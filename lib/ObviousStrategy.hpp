@@ -15,6 +15,17 @@ Codeword make_obvious_guess(
 	StrategyCost &cost,
 	StrategyObjective &obj);
 
+/**
+ * Estimates an upper bound of the number of distinct non-perfect feedbacks
+ * that any guess can produce against a set of possibilities, by grouping
+ * the possibilities by the colors they contain. The bound is capped at
+ * @c max_b.
+ */
+int estimate_max_branching(
+	const Rules &rules,
+	CodewordConstRange possibilities,
+	int max_b);
+
 /**
  * Strategy that makes an obviously-optimal guess when one exists.
  *
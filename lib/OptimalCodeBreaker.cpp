@@ -4,22 +4,163 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <atomic>
 #include <functional>
 #include <numeric>
+#include <memory>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <stdexcept>
 
 #include "Engine.hpp"
 #include "Strategy.hpp"
 #include "Equivalence.hpp"
+#include "Canonical.hpp"
 #include "ObviousStrategy.hpp"
 #include "HeuristicStrategy.hpp"
 #include "OptimalStrategy.hpp"
 #include "StrategyTree.hpp"
+#include "TranspositionTable.hpp"
+#include "CanonicalGuessCache.hpp"
+#include "SubproblemStore.hpp"
+#include "Heuristics.hpp"
+#include "CodeBreaker.hpp"
 #include "util/call_counter.hpp"
 #include "util/hr_timer.hpp"
 #include "util/io_format.hpp"
 
 using namespace Mastermind;
 
+/// Creates the response-dependent equivalence filter of the optimal
+/// search, which chains the color filter with the symmetry filter. The
+/// symmetry filter finds the symmetries of each cell, which may remove
+/// guesses that the other filters keep. It is not used if the guesses
+/// are restricted to the secrets before the last guess, because those
+/// are not mapped onto themselves by the symmetries of a cell.
+static EquivalenceFilter* CreateResponseEquivalenceFilter(
+	const Engine *e, const StrategyConstraints &c)
+{
+	if (c.pos_only)
+		return CreateColorEquivalenceFilter(e);
+	std::unique_ptr<EquivalenceFilter> color(CreateColorEquivalenceFilter(e));
+	std::unique_ptr<EquivalenceFilter> symmetry(CreateSymmetryEquivalenceFilter(e));
+	return new CompositeEquivalenceFilter(color.get(), symmetry.get());
+}
+
+/**
+ * Returns the canonical initial guesses, which are the representatives of
+ * the orbits of all codewords under peg and color permutations: before any
+ * guess is made, the constraint filter keeps exactly these, and the
+ * response-dependent filter keeps all of them. The supplied filter, which
+ * must not have any constraint added, is only used to check this.
+ */
+static CodewordList get_initial_guesses(
+	const Engine *e,
+	const EquivalenceFilter &filter)
+{
+	OrbitTable orbits(e);
+	CodewordList initial(orbits.representatives().begin(),
+		orbits.representatives().end());
+	assert(initial == filter.get_canonical_guesses(e->universe()));
+	(void)filter;
+	return initial;
+}
+
+/**
+ * Returns the codewords of a subset of candidates, given by their indices.
+ */
+static CodewordList select_codewords(
+	CodewordConstRange candidates,
+	const CodewordIndexList &subset)
+{
+	CodewordList selected(subset.size());
+	for (size_t i = 0; i < subset.size(); ++i)
+		selected[i] = candidates[subset[i]];
+	return selected;
+}
+
+/**
+ * Candidate guesses left by the response-independent filter, which are
+ * shared by the cells of a guess. They are given by their indices in the
+ * universe, or in a copy of the secrets before the guess if the guesses
+ * are restricted to them: the secrets are reordered in place as the cells
+ * are searched.
+ */
+struct PreFilteredGuesses
+{
+	CodewordList secrets;     // copy of the secrets if pos_only is set
+	CodewordIndexList subset; // empty if not computed yet
+};
+
+/**
+ * Returns the canonical guesses of a cell, which are filtered in two
+ * phases. First, all codewords (or the secrets before the guess if
+ * <code>c.pos_only</code> is set) are filtered by the response-independent
+ * filter; this is done once for all cells of the guess and kept in
+ * @c pre_filtered. Then a copy of the indices kept is narrowed by the
+ * response-dependent filter of the cell, so that only the final guesses
+ * are copied.
+ *
+ * If @c cache is not @c NULL, the canonical guesses of both phases are
+ * looked up in the cache by the state of the filters, and only computed
+ * if not found. The cache is not used if <code>c.pos_only</code> is set,
+ * because the guesses then depend on the secrets.
+ */
+static CodewordList get_cell_canonical_guesses(
+	const Engine *e,
+	CanonicalGuessCache *cache,
+	CodewordConstRange secrets,          // secrets before the guess
+	const EquivalenceFilter *pre_filter, // response-independent filter
+	const EquivalenceFilter *new_filter, // response-dependent filter
+	const StrategyConstraints &c,
+	PreFilteredGuesses &pre_filtered)
+{
+	if (c.pos_only)
+	{
+		cache = NULL;
+		if (pre_filtered.subset.empty())
+			pre_filtered.secrets.assign(secrets.begin(), secrets.end());
+	}
+	CodewordConstRange candidates = c.pos_only?
+		CodewordConstRange(pre_filtered.secrets) : e->universe();
+
+	CodewordIndexList subset;
+	CanonicalGuessCache::Key key;
+	if (cache != NULL)
+	{
+		key = CanonicalGuessCache::make_key(pre_filter, new_filter);
+		if (cache->probe(key, subset))
+			return select_codewords(candidates, subset);
+	}
+
+	if (pre_filtered.subset.empty())
+	{
+		CanonicalGuessCache::Key pre_key;
+		if (cache != NULL)
+			pre_key = CanonicalGuessCache::make_key(pre_filter);
+		if (cache == NULL || !cache->probe(pre_key, pre_filtered.subset))
+		{
+			pre_filtered.subset.resize(candidates.size());
+			std::iota(pre_filtered.subset.begin(),
+				pre_filtered.subset.end(), 0);
+			pre_filter->narrow_canonical_guesses(candidates,
+				pre_filtered.subset);
+			if (cache != NULL)
+				cache->store(pre_key, pre_filtered.subset);
+		}
+	}
+
+	subset = pre_filtered.subset;
+	new_filter->narrow_canonical_guesses(candidates, subset);
+	if (cache != NULL)
+		cache->store(key, subset);
+	return select_codewords(candidates, subset);
+}
+
 /**
  * Searches for an obviously optimal strategy for the given remaining secrets.
  *
@@ -93,423 +234,2449 @@ static StrategyCost fill_obviously_optimal_strategy(
 
 typedef HeuristicStrategy<Heuristics::MinimizeLowerBound> LowerBoundEstimator;
 
-/// @todo: Use heuristic code breaker to estimate an upper bound of total guesses
-/// This could be helpful in pruning obvious bad candidates
+#ifndef TT_MIN_SIZE
+#define TT_MIN_SIZE 10
+#endif
+
+/// Maximum number of secrets for which the table of the maximum number of
+/// secrets revealed within a given number of guesses is refined by looking
+/// ahead two guesses instead of one.
+#ifndef MAX_BREAKABLE_LOOKAHEAD_SIZE
+#define MAX_BREAKABLE_LOOKAHEAD_SIZE 10000
+#endif
+
+/// Maximum number of secrets in a cell for which a structural lower bound
+/// of the cost is computed before recursing.
+#ifndef CELL_LOWERBOUND_MAX_SIZE
+#define CELL_LOWERBOUND_MAX_SIZE 32
+#endif
 
 /**
- * Searches for an optimal strategy for the given set of remaining secrets.
- *
- * @param depth Depth of the current state. This is equal to the number of 
- *      guesses already made.
- * @param threshold Branch pruning threshold. If the cost of revealing all
- *      the secrets would reach or exceed this threshold, the function will
- *      fail. This parameter should be set to the currently best cost achieved
- *      by some known strategy.
- * @returns The cost of the optimal strategy if one is found, or zero if 
- *      one is not found either because some secret would require more than
- *      <code>c.max_depth</code> guesses to reveal, or because the cost of
- *      any strategy would reach or exceed the cut-off threshold.
- * @todo Add progress report (0% - 100%)
+ * Define OPTIMAL_PARALLEL_SEARCH = 1 to search the candidate guesses of
+ * the top levels of the search tree in parallel as OpenMP tasks. This
+ * requires OpenMP 3.0 or later; otherwise the search is always serial.
  */
-// @todo: We might change the equivalence filter interface to operate on
-// the input inplace? This could save a few memory copies but may change
-// the output.
-// all the secrets, or -1 if such optimal will not be less than _best_.
-static StrategyCost fill_strategy_tree(
-	const Engine *e,
-	CodewordRange secrets,            // remaining secrets; will be partitioned
-	CodewordRange candidates,         // canonical guesses; may be sorted
-	const EquivalenceFilter *filter1, // response-independent equivalence filter
-	const EquivalenceFilter *filter2, // response-dependent equivalence filter
-	LowerBoundEstimator &estimator,   // lower bound estimator
-	const int depth,                  // depth of the current state; root=0
-	StrategyObjective obj,            // objective
-	StrategyConstraints c,            // constraints
-	StrategyCost threshold,           // prunes branch if cost >= threshold
-	StrategyTree &tree,               // tree to store the strategy found
-	StrategyTree::iterator where      // iterator to the current state
-	)
-{
-	UPDATE_CALL_COUNTER("OptimalRecursion", (int)secrets.size());
+#ifndef OPTIMAL_PARALLEL_SEARCH
+#if defined(_OPENMP) && _OPENMP >= 200805
+#define OPTIMAL_PARALLEL_SEARCH 1
+#else
+#define OPTIMAL_PARALLEL_SEARCH 0
+#endif
+#endif
 
-	bool verbose = false; // (depth < 1);
+/**
+ * Define OPTIMAL_DISTRIBUTED_SEARCH = 1 to allow the candidate guesses of
+ * the root to be searched by worker processes connected over sockets.
+ * This requires the parallel search and POSIX sockets.
+ */
+#ifndef OPTIMAL_DISTRIBUTED_SEARCH
+#if OPTIMAL_PARALLEL_SEARCH && !defined(_WIN32)
+#define OPTIMAL_DISTRIBUTED_SEARCH 1
+#else
+#define OPTIMAL_DISTRIBUTED_SEARCH 0
+#endif
+#endif
 
-	VERBOSE_COUT("Checking " << secrets.size() << " remaining secrets");
+#if OPTIMAL_DISTRIBUTED_SEARCH
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "MessageChannel.hpp"
+#endif
 
-	// Fail if the secret set is empty or the max-depth is 0.
-	if (secrets.empty() || c.max_depth == 0)
-		return StrategyCost();
+/// Number of seconds a worker keeps trying to connect to the coordinator
+/// of a distributed search, and the coordinator waits for each worker.
+#ifndef WORKER_CONNECT_TIMEOUT
+#define WORKER_CONNECT_TIMEOUT 60
+#endif
 
-	// Initialize common variables.
-	const Feedback perfect = Feedback::perfectValue(e->rules());
-	const unsigned int nsecrets = (int)secrets.size();
+/// Maximum number of levels of the search tree that are searched in
+/// parallel.
+#define MAX_PARALLEL_DEPTH 4
 
-	// Short-cut if there is only one secret.
-	if (nsecrets == 1)
+#if OPTIMAL_PARALLEL_SEARCH
+/// Best cost found so far among the candidate guesses of a state that
+/// are searched in parallel. It is shared by all tasks of the state, so
+/// that a cut-off found by one task immediately prunes the others.
+struct SharedBound
+{
+	/// Steps of the best cost found so far in the high 32 bits, and the
+	/// rank of the guess (in the order the guesses would be searched by
+	/// the serial search) in the low 32 bits.
+	std::atomic<unsigned long long> best;
+
+	SharedBound() : best(~0ULL) { }
+
+	/// Returns the number of steps at or above which the search of the
+	/// guess of the given rank can no longer produce the best strategy.
+	/// A guess ranked before the best guess so far wins a tie, and so
+	/// does any guess if the objective breaks ties of steps.
+	unsigned int limit(size_t rank, StrategyObjective obj) const
 	{
-		tree.insert_child(where, StrategyNode(secrets[0], perfect));
-		return StrategyCost(1, 1, 1);
+		unsigned long long value = best.load(std::memory_order_relaxed);
+		if (value == ~0ULL)
+			return ~0U;
+		unsigned int steps = (unsigned int)(value >> 32);
+		size_t best_rank = (size_t)(value & 0xFFFFFFFFU);
+		return (obj == MinSteps && rank > best_rank)? steps : steps + 1;
 	}
 
-	// From now on, we will need to make at least one guess to reveal any 
-	// secret, and at least two guesses to reveal all secrets. This accounts
-	// for n total steps and 1 extra step. 
-	
-	// Update the constraints and threshold so that they will apply to a 
-	// situation after the initial guess.
-	if (c.max_depth == 1)
-		return StrategyCost();
-	else
-		--c.max_depth;
+	/// Publishes the best cost found so far.
+	void update(unsigned int steps, size_t rank)
+	{
+		best.store(((unsigned long long)steps << 32) | rank,
+			std::memory_order_relaxed);
+	}
+};
 
-	if (threshold.steps <= nsecrets)
-		return StrategyCost();
-	else
-		threshold.steps -= nsecrets;
+/// Cut-off imposed on a state by a guess searched in parallel at one of
+/// its ancestors: the state is useless if its cost reaches the limit of
+/// that guess minus @c offset steps.
+struct ExternalBound
+{
+	const SharedBound *shared;
+	size_t rank;
+	unsigned int offset;
+};
+#endif
 
-	// @bug The following criteria is problematic.
-	if (threshold.depth <= 1)
-		return StrategyCost();
-	else
-		--threshold.depth;
+/// Time and state budget of an anytime search. Once the budget runs out,
+/// each state stops trying new guesses and returns the best strategy found
+/// so far.
+class SearchBudget
+{
+	util::hr_timer _timer;
+	double _seconds;
+	unsigned long long _states;
+	std::atomic<unsigned long long> _entered;
+	std::atomic<bool> _expired;
+	unsigned int _open_bound;
+
+public:
+
+	/// Starts a budget of the given number of seconds and of states
+	/// entered, either of which is unlimited if zero.
+	SearchBudget(double seconds, unsigned long long states)
+		: _seconds(seconds), _states(states), _entered(0), _expired(false),
+		_open_bound(~0U)
+	{
+		_timer.start();
+	}
 
-	// Define a strategy cost comparer.
-	StrategyCostComparer superior(obj);
+	/// Counts a state entered by the search, and checks whether the budget
+	/// has run out. The state is not searched if it has.
+	bool enter()
+	{
+		if (_states > 0 &&
+			_entered.fetch_add(1, std::memory_order_relaxed) >= _states)
+			_expired.store(true, std::memory_order_relaxed);
+		return expired();
+	}
 
-#if 0
-	// If find_last is true, then we only cut-off a guess when it's
-	// strictly worse than the current best; otherwise, we cut-off
-	// a guess as long as it's no better than the current best.
-	int cut_off_delta = (c.find_last? 1 : 0);
-	cut_off += cut_off_delta ???
-#endif
+	/// Checks whether the budget has run out.
+	bool expired()
+	{
+		if (_expired.load(std::memory_order_relaxed))
+			return true;
+		if (_seconds <= 0 || _timer.stop() < _seconds)
+			return false;
+		_expired.store(true, std::memory_order_relaxed);
+		return true;
+	}
 
-	// Filter canonical guesses as candidates.
-	//CodewordList candidates = filter->get_canonical_guesses(e.universe());
-	//VERBOSE_COUT("Found " << candidates.size() << " canonical guesses.");
+	/// Records the lower bound (including the initial guess) of a guess
+	/// at the root whose search was not completed within the budget.
+	void leave_open(unsigned int steps)
+	{
+		#pragma omp critical (OptimalCodeBreaker_SearchBudget)
+		if (steps < _open_bound)
+			_open_bound = steps;
+	}
 
-	// Compute a lower bound of the cost for each candidate guess, exluding
-	// the cost of making the initial guess because this is the same for all
-	// candidates. Then sort the candidates by this lower bound so that more
-	// "promising" candidates are processed first. This helps to improve the
-	// upper bound as early as possible.
-	// @todo It might be better to rename scores to extra_cost.
-	typedef Heuristics::MinimizeLowerBound::score_t lowerbound_t;
-	std::vector<lowerbound_t> scores(candidates.size());
-	//estimator.make_guess(secrets, candidates, scores.data());
-	estimator.evaluate(secrets, candidates, scores.data());
+	/// Returns the smallest lower bound of the guesses at the root whose
+	/// search was not completed.
+	unsigned int open_bound() const { return _open_bound; }
+};
 
-	// @todo We might opt to remove the need to create an index array.
-	// Instead, we could scan for the element in each iteration.
-	std::vector<int> order(candidates.size());
-	std::iota(order.begin(), order.end(), 0);
+/// Number of levels at the top of the search tree whose state is saved in
+/// a checkpoint.
+#ifndef CHECKPOINT_DEPTH
+#define CHECKPOINT_DEPTH 3
+#endif
 
-	// Define SORT_CANDIDATES to 1 to explicitly sort the candidate guesses.
-	// Since many guesses will be pruned right away (especially if we have
-	// a good estimate of the lower-bound of the cost), it is usually faster
-	// to (linearly) search for the smallest element in each iteration,
-	// instead of sorting the whole array at the beginning. However, the
-	// results will be the same as long as we perform a stable sort.
-#define SORT_CANDIDATES 0
+/// State of the search at a level of the current search path, i.e. at a
+/// state whose candidate guesses are being tried.
+struct LevelState
+{
+	/// Identifies the state, so that a saved level is only restored to
+	/// the same state.
+	TranspositionTable::Key key;
 
-#if SORT_CANDIDATES
-	std::sort(order.begin(), order.end(), [&](int i, int j) -> bool {
-		if (superior(scores[i], scores[j]))
-			return true;
-		if (superior(scores[j], scores[i]))
-			return false;
-		return i < j;
-	});
-#endif
+	/// Result of looking up the transposition table when the state was
+	/// entered. It is saved because the table changes afterwards.
+	bool replay;
+	Codeword replay_guess;
+	StrategyCost tt_bound;
 
-	// Initialize state variables to store the best guess and its cost so far.
+	/// Rank of the guess being tried. The guesses ranked before it are
+	/// done.
+	size_t rank;
+
+	/// Best strategy found among the guesses done.
 	StrategyCost best;
-	StrategyTree best_tree(e->rules());
+	Codeword best_guess;
 
-	// Try each candidate guess.
-	size_t candidate_count = candidates.size();
-	for (size_t index = 0; index < candidate_count; ++index)
+	/// Number of cells of the guess being tried that are done, and the
+	/// lower bound of the cost of the guess.
+	size_t cells_done;
+	StrategyCost guess_bound;
+
+	LevelState() : replay(false), rank(0), cells_done(0)
 	{
-#if !SORT_CANDIDATES
-		// Find the guess with the lowest estimated cost in the remaining
-		// candidates, and swap it to the front.
-		auto min_it = std::min_element(order.begin() + index, order.end(),
-			[&](int i, int j) -> bool { 
-				return superior(scores[i], scores[j]); 
-		});
-		std::swap(*min_it, order[index]);
-#endif
-		size_t i = order[index];
-		Codeword guess = candidates[i];
+		key.h1 = key.h2 = 0;
+	}
+};
 
-		// Since we keep improving the upper bound dynamically,
-		// and we sort the candidates by their lower bound,
-		// we need to check here whether the remaining candidates
-		// are still worth checking.
-		if (!superior(scores[i], threshold))
-		{
-			VERBOSE_COUT("Pruned " << (candidate_count - index)
-				<< " remaining guesses: lower bound (" << scores[i]
-				<< ") >= cut-off (" << threshold << ")");
-#if 0
-			if (i == 0)
-			{
-				std::cout << "Very first pruned: best lower bound = "
-					<< scores[i] << ", cut-off = " << cut_off << std::endl;
-			}
-#endif
-			break;
-		}
+/// Level of the current search path. It refers to the variables of the
+/// search in progress at that level.
+struct FrontierLevel : LevelState
+{
+	/// The tree in which the strategy of the state is built, and the node
+	/// of the state. The nodes of the strategy start at position @c mark.
+	const StrategyTree *tree;
+	StrategyTree::const_iterator where;
+	size_t mark;
+
+	/// The best strategy found among the guesses done, which ends at
+	/// position @c best_end.
+	size_t best_end;
+
+	/// Lower bound (or exact cost) of each cell of the guess being tried.
+	size_t ncells;
+	const StrategyCost *lb_part;
+
+	/// Whether a guess is being tried. The strategy of its cells done
+	/// takes the positions from @c best_end to @c tree_size.
+	bool guessing;
+	size_t tree_size;
+
+	FrontierLevel() : tree(NULL), mark(0), best_end(0), ncells(0),
+		lb_part(NULL), guessing(false), tree_size(0) { }
+};
+
+/// Level of the search path restored from a checkpoint.
+struct SavedLevel : LevelState
+{
+	StrategyTree best_tree;
+	std::vector<StrategyCost> lb_part;
+	StrategyTree guess_tree;
+
+	explicit SavedLevel(const Rules &rules)
+		: best_tree(rules), guess_tree(rules) { }
+};
+
+/// Writes the nodes of a strategy tree at positions <code>[first, last)
+/// </code> in preorder. The nodes are in the branch of @c where, whose
+/// first child is at position @c mark, and their depth is written relative
+/// to @c where.
+static void write_tree_nodes(std::ostream &os, const StrategyTree &tree,
+	StrategyTree::const_iterator where, size_t mark, size_t first, size_t last)
+{
+	assert(mark <= first && first <= last);
+	os << (last - first) << '\n';
+	auto nodes = tree.traverse(where);
+	auto it = nodes.begin();
+	for (size_t pos = mark - 1; pos < first; ++pos)
+		++it;
+	for (size_t pos = first; pos < last; ++pos, ++it)
+	{
+		os << (it.depth() - where.depth()) << ' ' << it->guess().pack() << ' '
+			<< (int)it->response().pack() << '\n';
+	}
+}
+
+/// Reads the nodes written by <code>write_tree_nodes()</code> and appends
+/// them to a tree that only has the root node.
+static bool read_tree_nodes(std::istream &is, StrategyTree &tree)
+{
+	size_t n;
+	if (!(is >> n))
+		return false;
+
+	// The last node read at each depth is the parent of a node one level
+	// deeper.
+	std::vector<StrategyTree::iterator> path(1, tree.root());
+	for (size_t i = 0; i < n; ++i)
+	{
+		size_t depth;
+		Codeword::compact_type guess;
+		unsigned int response;
+		if (!(is >> depth >> guess >> response) ||
+			depth < 1 || depth > path.size())
+			return false;
+		path.resize(depth);
+		path.push_back(tree.insert_child(path[depth-1], StrategyNode(
+			Codeword::unpack(guess), Feedback::unpack((Feedback::compact_type)response))));
+	}
+	return true;
+}
 
-		VERBOSE_COUT("Checking guess " << (i+1) << " of "
-			<< candidate_count << " (" << guess << ") -> ");
+static void write_cost(std::ostream &os, const StrategyCost &cost)
+{
+	os << ' ' << cost.steps << ' ' << cost.depth << ' ' << cost.worst;
+}
 
-		// If there's a limit on the maximum number of guesses allowed,
-		// check if we can prune it.
-		if (scores[i].depth > c.max_depth)
-		{
-			if (verbose)
-				std::cout << "Skipped: guess will have too many steps"
-				<< std::endl;
-			continue;
-		}
+static bool read_cost(std::istream &is, StrategyCost &cost)
+{
+	unsigned int steps, depth, worst;
+	if (!(is >> steps >> depth >> worst))
+		return false;
+	cost = StrategyCost(steps, (unsigned short)depth, (unsigned short)worst);
+	return true;
+}
 
-#if 0
-		static size_t test_counter = 0;
-		++test_counter;
-		if (test_counter == 8479)
-		{
-			__debugbreak();
-		}
-#endif
+/**
+ * Saves the state of the search to a file periodically, so that the search
+ * can be resumed after it is interrupted.
+ *
+ * The state consists of the top levels of the current search path and the
+ * content of the transposition table. For each level, the checkpoint keeps
+ * the best strategy among the guesses done, and for the guess being tried,
+ * the strategy of its cells done and the bounds of its other cells. A
+ * resumed search skips the work done and otherwise proceeds exactly as the
+ * interrupted one, so it finds the same strategy.
+ *
+ * A checkpoint is only saved when a guess or a cell at one of the top
+ * levels is done, which is when the state of the levels is consistent.
+ */
+class SearchCheckpoint
+{
+	std::string _path;
+	double _interval;
+	util::hr_timer _timer;
+	double _last_saved;
+	bool _failed;
 
-		// Partition the remaining secrets using this guess.
-		// Note that after successive calls to @c partition,
-		// the order of the secrets are shuffled. However,
-		// that should not impact the optimality of the result.
-		CodewordPartition cells = e->partition(secrets, guess);
+	// Identifies the search; a checkpoint is only resumed by the same search.
+	std::string _header;
+	const TranspositionTable *_tt;
 
-		// Sort the partitions by their size, so that smaller partitions
-		// (i.e. smaller search trees) are processed first. This helps
-		// to improve the lower bound (slack) at an earlier stage.
-		std::array<int,Feedback::MaxOutcomes> responses;
-		size_t nresponses = cells.size();
-		std::iota(responses.begin(), responses.begin() + nresponses, 0);
-		std::sort(responses.begin(), responses.begin() + nresponses,
-			[&cells](int i, int j) -> bool
-		{
-			if (cells[i].size() == 0)
-				return false;
-			if (cells[j].size() == 0)
-				return true;
-			if (cells[i].size() < cells[j].size())
-				return true;
-			if (cells[j].size() < cells[i].size())
-				return false;
-			return i < j;
-		});
+	FrontierLevel _levels[CHECKPOINT_DEPTH];
 
-		// Find the number of availble responses, and skip this guess if it 
-		// generates only one response.
-		while (nresponses > 0 && cells[responses[nresponses-1]].empty())
-			--nresponses;
-		if (nresponses <= 1)
+	// Levels restored from a checkpoint, and the depth of the next level
+	// to restore.
+	std::vector<SavedLevel> _saved;
+	size_t _next;
+
+	static const char * magic() { return "mmstrat-checkpoint"; }
+
+public:
+
+	/// Creates a checkpoint that is saved to the given file at most once
+	/// every @c interval seconds.
+	SearchCheckpoint(const std::string &path, double interval,
+		const std::string &header, const TranspositionTable *tt)
+		: _path(path), _interval(interval), _last_saved(0), _failed(false),
+		_header(header), _tt(tt), _next(0)
+	{
+		_timer.start();
+	}
+
+	/// Returns the level of the search path at the given depth.
+	FrontierLevel& level(int depth)
+	{
+		assert(depth >= 0 && depth < CHECKPOINT_DEPTH);
+		return _levels[depth];
+	}
+
+	/// Saves the levels of the search path up to the given depth if the
+	/// interval has elapsed since the last checkpoint.
+	void save_if_due(int depth)
+	{
+		if (_timer.stop() - _last_saved >= _interval)
 		{
-			if (verbose)
-				std::cout << "Skipped: guess produces unit partition"
-				<< std::endl;
-			continue;
+			save(depth);
+			_last_saved = _timer.stop();
 		}
+	}
 
-		// Estimate a lower bound of the cost of revealing the secrets in 
-		// each partition, NOT counting the cost of making the initial guess.
-		// If the total lower bound reaches or exceeds the cut-off threshold,
-		// we can prune this guess.
-		// Note: this step is redundant because we have already calculated
-		// the same score before.
-		StrategyCost lb_part[256];
-		StrategyCost lb;
-		for (size_t j = 0; j < nresponses; ++j)
+	/// Saves the levels of the search path up to the given depth. The
+	/// file is replaced atomically, so that an interruption while saving
+	/// leaves the previous checkpoint intact.
+	void save(int depth)
+	{
+		std::string temp = _path + ".tmp";
 		{
-			Feedback feedback = Feedback(responses[j]);
-			if (feedback != perfect)
+			std::ofstream os(temp.c_str());
+			os << magic() << '\n' << _header << '\n' << (depth + 1) << '\n';
+			for (int d = 0; d <= depth; ++d)
 			{
-				lowerbound_t estimate =
-					estimator.heuristic().simple_estimate((int)cells[feedback.value()].size());
-				lb_part[j] = estimate;
-				lb += lb_part[j];
+				const FrontierLevel &level = _levels[d];
+				os << level.key.h1 << ' ' << level.key.h2 << ' '
+					<< (level.replay? 1 : 0) << ' ' << level.replay_guess.pack();
+				write_cost(os, level.tt_bound);
+				os << ' ' << level.rank;
+				write_cost(os, level.best);
+				os << ' ' << level.best_guess.pack() << '\n';
+				write_tree_nodes(os, *level.tree, level.where, level.mark,
+					level.mark, level.best_end);
+
+				// Save the guess being tried.
+				size_t ncells = level.guessing? level.ncells : 0;
+				os << ncells << ' ' << (ncells? level.cells_done : 0);
+				write_cost(os, level.guess_bound);
+				for (size_t j = 0; j < ncells; ++j)
+					write_cost(os, level.lb_part[j]);
+				os << '\n';
+				if (ncells > 0)
+					write_tree_nodes(os, *level.tree, level.where, level.mark,
+						level.best_end, level.tree_size);
+			}
+			os << (_tt? 1 : 0) << '\n';
+			if (_tt)
+				_tt->save(os);
+			os << "end" << std::endl;
+			if (!os)
+			{
+				if (!_failed)
+					std::cerr << "Warning: cannot write checkpoint file " << temp << std::endl;
+				_failed = true;
+				return;
 			}
 		}
 
-		// Since this is a double-computation, we shouldn't be pruning
-		// this guess here.
-		assert(lb == scores[i]);
-
-		if (verbose)
+		// std::rename() does not replace an existing file on some platforms.
+		if (std::rename(temp.c_str(), _path.c_str()) != 0)
 		{
-			std::cout << nresponses << " cells:";
-			for (size_t j = 0; j < nresponses; ++j)
+			std::remove(_path.c_str());
+			if (std::rename(temp.c_str(), _path.c_str()) != 0 && !_failed)
 			{
-				if (j > 0)
-					std::cout << ',';
-				std::cout << cells[responses[j]].size();
+				std::cerr << "Warning: cannot write checkpoint file " << _path << std::endl;
+				_failed = true;
 			}
-			std::cout << "; lower bound = " 	<< lb 
-				<< ", best = " << best << std::endl;
 		}
+	}
 
-		// Find the best guess for each partition. We adopt a two-phase
-		// equivalence filtering method. First, we filter all possible
-		// codewords by (response-indepedent) constraint equivalence.
-		// This can be done once for all response classes. Then, for each
-		// individual response class, we apply the response-dependent 
-		// color equivalence filter.
-		CodewordList pre_filtered;
-		std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
-		pre_filter->add_constraint(guess, Feedback(), e->universe());
-		// @todo we may change the interface of add_constraint to return
-		// a new filter.
-
-		bool pruned = false;
-		StrategyTree this_tree(e->rules());
-		for (size_t j = 0; j < nresponses && !pruned; ++j)
+	/// Loads a checkpoint saved by the same search, and restores the
+	/// transposition table. Throws <code>std::runtime_error</code> if the
+	/// checkpoint cannot be read or is not saved by the same search.
+	void load(const Rules &rules, TranspositionTable *tt)
+	{
+		std::ifstream is(_path.c_str());
+		if (!is)
+			throw std::runtime_error("cannot open checkpoint file " + _path);
+
+		std::string magic, header;
+		std::getline(is, magic);
+		std::getline(is, header);
+		if (magic != SearchCheckpoint::magic())
+			throw std::runtime_error(_path + " is not a checkpoint file");
+		if (header != _header)
+			throw std::runtime_error("checkpoint file " + _path +
+				" was saved by a search with different rules or options");
+
+		size_t nlevels;
+		bool ok = (is >> nlevels) && nlevels <= CHECKPOINT_DEPTH;
+		_saved.clear();
+		for (size_t d = 0; ok && d < nlevels; ++d)
 		{
-			Feedback feedback = Feedback(responses[j]);
-			const CodewordRange &cell = cells[feedback.value()];
+			SavedLevel level(rules);
+			int replay;
+			Codeword::compact_type replay_guess, best_guess;
+			size_t ncells;
+			ok = (is >> level.key.h1 >> level.key.h2 >> replay >> replay_guess)
+				&& read_cost(is, level.tt_bound) && (is >> level.rank)
+				&& read_cost(is, level.best) && (is >> best_guess)
+				&& read_tree_nodes(is, level.best_tree)
+				&& (is >> ncells >> level.cells_done)
+				&& read_cost(is, level.guess_bound)
+				&& ncells <= (size_t)Feedback::MaxOutcomes && level.cells_done <= ncells;
+			level.replay = (replay != 0);
+			level.replay_guess = Codeword::unpack(replay_guess);
+			level.best_guess = Codeword::unpack(best_guess);
+			level.lb_part.resize(ncells);
+			for (size_t j = 0; ok && j < ncells; ++j)
+				ok = read_cost(is, level.lb_part[j]);
+			if (ok && ncells > 0)
+				ok = read_tree_nodes(is, level.guess_tree);
+			_saved.push_back(level);
+		}
 
-			// Add this node to the strategy tree.
-			StrategyNode node(guess, feedback);
-			StrategyTree::iterator it = this_tree.insert_child(this_tree.root(), node);
+		int has_tt;
+		ok = ok && (is >> has_tt) && (has_tt != 0) == (tt != NULL);
+		if (ok && tt)
+			ok = tt->load(is);
+		std::string end;
+		if (!ok || !(is >> end) || end != "end")
+			throw std::runtime_error("checkpoint file " + _path + " is corrupt");
+		_next = 0;
+	}
 
-			// Do not recurse for a perfect match.
-			if (feedback == perfect)
+	/// Returns the saved level to restore to a state entered by the search,
+	/// or @c NULL if the state is not on the saved search path. Each saved
+	/// level is restored once, in order of depth.
+	const SavedLevel * restore(int depth, const TranspositionTable::Key &key)
+	{
+		if (_next >= _saved.size())
+			return NULL;
+		const SavedLevel &level = _saved[_next];
+		if ((size_t)depth != _next || level.key.h1 != key.h1 || level.key.h2 != key.h2)
+		{
+			// The search has left the saved path, which does not happen
+			// unless the search is different. Stop restoring then.
+			_next = _saved.size();
+			return NULL;
+		}
+		++_next;
+		return &level;
+	}
+};
+
+#if OPTIMAL_DISTRIBUTED_SEARCH
+class WorkerPool;
+#endif
+
+/// Adds to a counter of the search statistics, which may be updated by
+/// multiple threads.
+template <class T>
+static inline void add_statistic(T &counter, T n)
+{
+	#pragma omp atomic
+	counter += n;
+}
+
+/// Adds the time spent in a state to the search statistics when the
+/// state is left.
+class StateTimer
+{
+	OptimalSearchLevelStatistics *_stats;
+	util::hr_timer _timer;
+
+	StateTimer(const StateTimer &);
+	StateTimer& operator = (const StateTimer &);
+
+public:
+
+	explicit StateTimer(OptimalSearchLevelStatistics *stats) : _stats(stats)
+	{
+		if (_stats)
+			_timer.start();
+	}
+
+	~StateTimer()
+	{
+		if (_stats)
+			add_statistic(_stats->seconds, _timer.stop());
+	}
+};
+
+/// Search-wide state passed down to the recursive calls of the optimal
+/// strategy search.
+struct SearchContext
+{
+	/// Transposition table that caches solved subproblems, or @c NULL
+	/// if not used.
+	TranspositionTable *tt;
+
+	/// Persistent store of the subproblems solved by this and previous
+	/// searches, or @c NULL if not used.
+	SubproblemStore *store;
+
+	/// Cache of the canonical guesses of the equivalence filter states,
+	/// or @c NULL if not used.
+	CanonicalGuessCache *guess_cache;
+
+	/// Time and state budget of the search, or @c NULL if unlimited.
+	SearchBudget *budget;
+
+	/// Statistics of the states searched, or @c NULL if not collected.
+	OptimalSearchStatistics *statistics;
+
+	/// Checkpoint of the search, or @c NULL if not saved.
+	SearchCheckpoint *checkpoint;
+
+	/// Heuristic strategy whose cost seeds the threshold of subproblems
+	/// with at least @c seed_size secrets, or @c NULL if not used.
+	const Strategy *seed_strategy;
+	size_t seed_size;
+
+	/// States with a depth less than this value search their candidate
+	/// guesses in parallel.
+	int parallel_depth;
+
+#if OPTIMAL_PARALLEL_SEARCH
+	/// Cut-offs imposed by the guesses searched in parallel at the
+	/// ancestors of the current state.
+	ExternalBound bounds[MAX_PARALLEL_DEPTH];
+	int nbounds;
+#endif
+
+#if OPTIMAL_DISTRIBUTED_SEARCH
+	/// Worker processes that search the candidate guesses of the root,
+	/// or @c NULL if the search runs in this process only.
+	WorkerPool *workers;
+#endif
+
+	SearchContext() : tt(NULL), store(NULL), guess_cache(NULL), budget(NULL),
+		statistics(NULL),
+		checkpoint(NULL), seed_strategy(NULL), seed_size(0), parallel_depth(0)
+	{
+#if OPTIMAL_PARALLEL_SEARCH
+		nbounds = 0;
+#endif
+#if OPTIMAL_DISTRIBUTED_SEARCH
+		workers = NULL;
+#endif
+	}
+
+	/// Returns the statistics of the states at the given depth, or @c NULL
+	/// if they are not collected.
+	OptimalSearchLevelStatistics * level_statistics(int depth) const
+	{
+		return (statistics && (size_t)depth < statistics->levels.size())?
+			&statistics->levels[depth] : NULL;
+	}
+
+	/// Looks up a solved subproblem in the transposition table and in the
+	/// persistent store. Returns @c true and stores the better result in
+	/// @c entry if the subproblem is found in either.
+	bool probe(const TranspositionTable::Key &key,
+		TranspositionTable::Entry &entry) const
+	{
+		bool found = (tt != NULL && tt->probe(key, entry));
+		TranspositionTable::Entry stored;
+		if (store != NULL && !(found && entry.type == TranspositionTable::Exact)
+			&& store->probe(key, stored))
+		{
+			if (!found || stored.type == TranspositionTable::Exact ||
+				stored.cost.steps > entry.cost.steps)
+				entry = stored;
+			found = true;
+		}
+		return found;
+	}
+
+	/// Stores the result of a subproblem in the transposition table and
+	/// in the persistent store.
+	void record(const TranspositionTable::Key &key,
+		TranspositionTable::BoundType type, const StrategyCost &cost,
+		const Codeword &guess, size_t size) const
+	{
+		if (tt)
+			tt->store(key, type, cost, guess, size);
+		if (store)
+			store->store(key, type, cost, guess, size);
+	}
+
+	/// Shifts the external cut-offs to apply to a state whose cost is
+	/// @c steps less than the cost of the current state.
+	void shift(unsigned int steps)
+	{
+#if OPTIMAL_PARALLEL_SEARCH
+		for (int k = 0; k < nbounds; ++k)
+			bounds[k].offset += steps;
+#else
+		(void)steps;
+#endif
+	}
+
+	/// Returns the level of the search path at the given depth if it is
+	/// saved in the checkpoint, or @c NULL otherwise.
+	FrontierLevel * checkpoint_level(int depth) const
+	{
+		return (checkpoint && depth < CHECKPOINT_DEPTH)?
+			&checkpoint->level(depth) : NULL;
+	}
+
+	/// Saves a checkpoint of the levels of the search path up to the given
+	/// depth if one is due. No checkpoint is saved once the budget has run
+	/// out, because the search is then cut short.
+	void save_checkpoint(int depth) const
+	{
+		if (!(budget && budget->expired()))
+			checkpoint->save_if_due(depth);
+	}
+
+	/// Tightens the steps of a threshold by the external cut-offs.
+	void tighten(StrategyCost &threshold, StrategyObjective obj) const
+	{
+#if OPTIMAL_PARALLEL_SEARCH
+		for (int k = 0; k < nbounds; ++k)
+		{
+			unsigned int limit = bounds[k].shared->limit(bounds[k].rank, obj);
+			limit = (limit > bounds[k].offset)? limit - bounds[k].offset : 0;
+			if (threshold.steps > limit)
+				threshold.steps = limit;
+		}
+#else
+		(void)threshold;
+		(void)obj;
+#endif
+	}
+};
+
+/**
+ * Set of the partitions of a set of secrets induced by the candidate
+ * guesses of a state.
+ *
+ * Two guesses that partition the secrets into the same cells, and reveal
+ * the same secret (if any) in the first step, have strategies of the same
+ * cost, even if they are not equivalent under the equivalence filters.
+ * Since the search keeps the first guess that attains the optimal cost,
+ * a guess whose partition is already in the set can be skipped without
+ * changing the result.
+ */
+class PartitionSet
+{
+	const Engine *_e;
+	CodewordConstRange _secrets;
+	FeedbackList _feedbacks;
+
+	// Partitions in the set, as the label of the cell of each secret. The
+	// cells are labeled in order of their first secret, except that the
+	// cell of the secret revealed by the guess is labeled 0.
+	std::vector<std::vector<unsigned char>> _partitions;
+	std::unordered_multimap<uint64_t, size_t> _index;
+
+public:
+
+	/// Creates an empty set of the partitions of the given secrets.
+	PartitionSet(const Engine *e, CodewordConstRange secrets)
+		: _e(e), _secrets(secrets) { }
+
+	/// Adds the partition induced by a guess. Returns @c false if the
+	/// partition is already in the set. If the set is created without
+	/// secrets, such as when there is a single candidate guess, every
+	/// guess is accepted.
+	bool insert(const Codeword &guess)
+	{
+		if (_secrets.empty())
+			return true;
+
+		const Feedback perfect = Feedback::perfectValue(_e->rules());
+		_e->compare(guess, _secrets, _feedbacks);
+
+		unsigned char labels[Feedback::MaxOutcomes];
+		std::fill(labels, labels + Feedback::MaxOutcomes, 0);
+		unsigned char nlabels = 1;
+		std::vector<unsigned char> partition(_feedbacks.size());
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < _feedbacks.size(); ++i)
+		{
+			Feedback feedback = _feedbacks[i];
+			unsigned char &label = labels[feedback.value()];
+			if (label == 0 && feedback != perfect)
+				label = nlabels++;
+			partition[i] = label;
+			hash = (hash ^ label) * 1099511628211ULL;
+		}
+
+		auto range = _index.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (_partitions[it->second] == partition)
+				return false;
+		}
+		_index.insert(std::make_pair(hash, _partitions.size()));
+		_partitions.push_back(partition);
+		return true;
+	}
+
+	/// Returns the responses of the secrets, in their initial order, to
+	/// the guess last inserted. The caller may reorder them along with
+	/// the secrets.
+	FeedbackList& feedbacks() { return _feedbacks; }
+};
+
+// Number of candidates selected by a linear scan before the remaining
+// candidates are put in a heap. Most states are done after trying a few
+// candidates, and a scan is cheaper than building the heap for them.
+#ifndef CANDIDATE_QUEUE_SCAN_COUNT
+#define CANDIDATE_QUEUE_SCAN_COUNT 8
+#endif
+
+/**
+ * Schedules the candidate guesses of a state in order of the lower bound
+ * of their cost, one at a time, so that the candidates pruned by the
+ * threshold are never put in order.
+ *
+ * Each selection yields the same guess as finding the first minimum of
+ * the remaining candidates and swapping it to the front of them. Of the
+ * guesses with the same bound, the one at the earliest position comes
+ * first, where a guess displaced by a swap takes the position of the
+ * guess selected. After the first few selections, the remaining
+ * candidates are kept in a binary heap keyed by their bound and position,
+ * so a selection takes logarithmic rather than linear time.
+ */
+class CandidateQueue
+{
+	std::vector<int> &_order;
+	const StrategyCost *_scores;
+	StrategyCostComparer _superior;
+	std::vector<size_t> _position; // position of each candidate in _order
+	std::vector<int> _heap;        // candidates not yet selected
+	std::vector<size_t> _slot;     // index of each candidate in _heap
+
+	bool before(int i, int j) const
+	{
+		if (_superior(_scores[i], _scores[j]))
+			return true;
+		if (_superior(_scores[j], _scores[i]))
+			return false;
+		return _position[i] < _position[j];
+	}
+
+	void place(size_t k, int i)
+	{
+		_heap[k] = i;
+		_slot[i] = k;
+	}
+
+	void sift_down(size_t k)
+	{
+		const int i = _heap[k];
+		const size_t n = _heap.size();
+		for (size_t child = 2*k+1; child < n; child = 2*k+1)
+		{
+			if (child + 1 < n && before(_heap[child+1], _heap[child]))
+				++child;
+			if (!before(_heap[child], i))
+				break;
+			place(k, _heap[child]);
+			k = child;
+		}
+		place(k, i);
+	}
+
+	// Puts the candidates from the given position on in a heap.
+	void build_heap(size_t index)
+	{
+		_position.resize(_order.size());
+		_slot.resize(_order.size());
+		_heap.assign(_order.begin() + index, _order.end());
+		for (size_t k = index; k < _order.size(); ++k)
+			_position[_order[k]] = k;
+		for (size_t k = 0; k < _heap.size(); ++k)
+			_slot[_heap[k]] = k;
+		for (size_t k = _heap.size() / 2; k-- > 0; )
+			sift_down(k);
+	}
+
+public:
+
+	/// Creates a queue of the candidates in the given order, which is
+	/// updated as the candidates are selected.
+	CandidateQueue(std::vector<int> &order, const StrategyCost *scores,
+		StrategyObjective obj)
+		: _order(order), _scores(scores), _superior(obj) { }
+
+	/// Moves the remaining candidate with the lowest bound to the given
+	/// position, which must be the first position not yet selected.
+	void select(size_t index)
+	{
+		if (index < CANDIDATE_QUEUE_SCAN_COUNT)
+		{
+			auto min_it = std::min_element(_order.begin() + index, _order.end(),
+				[this](int i, int j) -> bool {
+					return _superior(_scores[i], _scores[j]);
+			});
+			std::swap(*min_it, _order[index]);
+			return;
+		}
+		if (index == CANDIDATE_QUEUE_SCAN_COUNT)
+			build_heap(index);
+
+		assert(!_heap.empty());
+		const int best = _heap[0];
+		const int last = _heap.back();
+		_heap.pop_back();
+		if (best != last)
+		{
+			place(0, last);
+			sift_down(0);
+		}
+
+		// The candidate at the front takes the position of the one
+		// selected, which is further back, so it moves down the heap.
+		const int front = _order[index];
+		if (front != best)
+		{
+			size_t p = _position[best];
+			_order[p] = front;
+			_position[front] = p;
+			_order[index] = best;
+			_position[best] = index;
+			sift_down(_slot[front]);
+		}
+	}
+};
+
+static StrategyCost fill_strategy_tree(
+	const Engine *e,
+	CodewordRange secrets,
+	CodewordRange candidates,
+	const EquivalenceFilter *filter1,
+	const EquivalenceFilter *filter2,
+	LowerBoundEstimator &estimator,
+	const SearchContext &ctx,
+	const int depth,
+	StrategyObjective obj,
+	StrategyConstraints c,
+	StrategyCost threshold,
+	StrategyTree &tree,
+	StrategyTree::iterator where);
+
+/**
+ * Computes the cost of the strategy that a heuristic strategy makes for
+ * the given remaining secrets, including the initial guess. The candidate
+ * guesses are filtered in the same way as in the optimal search, so the
+ * cost is an upper bound of the cost of the optimal strategy.
+ *
+ * @returns The cost of the heuristic strategy, or zero if it takes more
+ *      than <code>c.max_depth</code> guesses to reveal some secret.
+ */
+static StrategyCost heuristic_strategy_cost(
+	const Engine *e,
+	CodewordRange secrets,            // remaining secrets; will be partitioned
+	CodewordConstRange candidates,    // canonical guesses
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const Strategy *strat,            // heuristic strategy
+	CanonicalGuessCache *cache,       // cache of canonical guesses, or NULL
+	StrategyObjective obj,            // objective
+	StrategyConstraints c             // constraints
+	)
+{
+	const unsigned int nsecrets = (unsigned int)secrets.size();
+	if (nsecrets == 0 || c.max_depth == 0)
+		return StrategyCost();
+	if (nsecrets == 1)
+		return StrategyCost(1, 1, 1);
+
+	StrategyCost cost;
+	if (c.use_obvious)
+	{
+		StrategyObjective obvious_obj = obj;
+		if (!make_obvious_guess(e, secrets, c.max_depth, obj, cost,
+			obvious_obj).IsEmpty())
+			return cost;
+	}
+
+	Codeword guess = strat->make_guess(secrets, candidates);
+	if (guess.IsEmpty() || c.max_depth == 1)
+		return StrategyCost();
+	--c.max_depth;
+
+	// Fail if the guess does not split the secrets.
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	CodewordPartition cells = e->partition(secrets, guess);
+	for (size_t j = 0; j < cells.size(); ++j)
+	{
+		if (cells[j].size() == nsecrets && Feedback(j) != perfect)
+			return StrategyCost();
+	}
+
+	std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
+	pre_filter->add_constraint(guess, Feedback(), e->universe());
+	PreFilteredGuesses pre_filtered;
+
+	// The guess reveals the secret of the perfect cell, and takes one
+	// step for each of the other secrets.
+	cost = StrategyCost(nsecrets, 1, 0);
+	for (size_t j = 0; j < cells.size(); ++j)
+	{
+		Feedback feedback = Feedback(j);
+		CodewordRange cell = cells[j];
+		StrategyCost cell_cost;
+		if (cell.empty())
+			continue;
+		if (feedback == perfect)
+		{
+			cell_cost = StrategyCost(0, 0, 1);
+		}
+		else
+		{
+			std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
+			new_filter->add_constraint(guess, feedback, cell);
+			CodewordList canonical = get_cell_canonical_guesses(e, cache,
+				secrets, pre_filter.get(), new_filter.get(), c, pre_filtered);
+			cell_cost = heuristic_strategy_cost(e, cell, canonical,
+				pre_filter.get(), new_filter.get(), strat, cache, obj, c);
+			if (!cell_cost)
+				return StrategyCost();
+		}
+
+		// Merge the depth and worst count of the cell.
+		cost.steps += cell_cost.steps;
+		if (cell_cost.depth + 1 > cost.depth)
+		{
+			cost.depth = cell_cost.depth + 1;
+			cost.worst = cell_cost.worst;
+		}
+		else if (cell_cost.depth + 1 == cost.depth)
+		{
+			cost.worst += cell_cost.worst;
+		}
+	}
+	return cost;
+}
+
+/**
+ * Estimates a lower bound of the cost of revealing a small set of secrets,
+ * including the initial guess. This bound is tighter than the simple
+ * estimate, which assumes that the initial guess is one of the secrets
+ * and that every guess produces every feedback.
+ *
+ * No guess produces more distinct feedbacks against the secrets (or a
+ * subset of them) than allowed by the colors the secrets contain. With
+ * this branching factor, a guess from the secrets is bounded by the cells
+ * it partitions the secrets into; a guess outside the secrets reveals no
+ * secret in the first step.
+ */
+static StrategyCost estimate_cell_lowerbound(
+	const Engine *e,
+	CodewordConstRange secrets,
+	LowerBoundEstimator &estimator)
+{
+	const Heuristics::MinimizeLowerBound &h = estimator.heuristic();
+	const int n = (int)secrets.size();
+	const int b = estimate_max_branching(e->rules(), secrets, h.max_branching());
+	UPDATE_CALL_COUNTER("CellLowerBound", n);
+
+	// A guess outside the secrets reveals at most b^(d-1) secrets in
+	// the d-th step for d > 1.
+	StrategyCost lb = h.estimate_impossible(n, b);
+
+	// A guess from the secrets reveals one secret in the first step.
+	for (int i = 0; i < n; ++i)
+	{
+		FeedbackFrequencyTable freq = e->compare(secrets[i], secrets);
+		StrategyCost cost(n, 0, 0);
+		for (size_t j = 0; j < freq.size() - 2; ++j)
+		{
+			cost += h.estimate(freq[j], b);
+		}
+		++cost.depth;
+		lb.steps = std::min(lb.steps, cost.steps);
+		lb.depth = std::min(lb.depth, cost.depth);
+	}
+	return lb;
+}
+
+/**
+ * Searches for the best strategy that starts with the given guess.
+ *
+ * The constraints, threshold and context apply to the situation after
+ * the guess is made, i.e. they do not account for the guess itself.
+ *
+ * @param secrets Remaining secrets. They are partitioned by the guess.
+ * @param feedbacks If not @c NULL, the responses of the secrets to the
+ *      guess, which saves comparing them again. They are reordered along
+ *      with the secrets.
+ * @param score Lower bound of the cost of the guess, as computed by
+ *      the lower bound estimator.
+ * @param restored If not @c NULL, the search of the guess resumes from
+ *      this level of a checkpoint.
+ * @param tree Tree to store the strategy found. The strategy is appended
+ *      as children of @c where, which stands for the state before the
+ *      guess. If the guess is pruned, the nodes appended are left in the
+ *      tree for the caller to roll back.
+ * @param cost Receives the cost of the strategy found, excluding the
+ *      guess itself.
+ * @returns @c true if a strategy is found whose cost is lower than
+ *      the threshold, or @c false if the guess is pruned.
+ */
+static bool search_guess(
+	const Engine *e,
+	CodewordRange secrets,            // remaining secrets; will be partitioned
+	const Codeword &guess,            // the guess to make
+	FeedbackList *feedbacks,          // responses to the guess, or NULL
+	const StrategyCost &score,        // lower bound of the cost of the guess
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	LowerBoundEstimator &estimator,   // lower bound estimator
+	const SearchContext &ctx,         // search-wide state
+	const int depth,                  // depth of the current state; root=0
+	StrategyObjective obj,            // objective
+	StrategyConstraints c,            // constraints
+	StrategyCost threshold,           // prunes guess if cost >= threshold
+	const SavedLevel *restored,       // state restored from a checkpoint
+	StrategyTree &tree,               // tree to store the strategy found
+	StrategyTree::iterator where,     // node of the state before the guess
+	StrategyCost &cost                // cost of the strategy found
+	)
+{
+	bool verbose = false; // (depth < 1);
+	const size_t guess_begin = tree.size();
+
+	OptimalSearchLevelStatistics *stats = ctx.level_statistics(depth);
+	if (stats)
+		add_statistic(stats->candidates, 1ULL);
+
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	StrategyCostComparer superior(obj);
+	typedef Heuristics::MinimizeLowerBound::score_t lowerbound_t;
+
+	// Partition the remaining secrets using this guess.
+	// Note that after successive calls to @c partition,
+	// the order of the secrets are shuffled. However,
+	// that should not impact the optimality of the result.
+	CodewordPartition cells = feedbacks?
+		e->partition(secrets, *feedbacks) : e->partition(secrets, guess);
+
+	// Sort the partitions by their size, so that smaller partitions
+	// (i.e. smaller search trees) are processed first. This helps
+	// to improve the lower bound (slack) at an earlier stage.
+	std::array<int,Feedback::MaxOutcomes> responses;
+	size_t nresponses = cells.size();
+	std::iota(responses.begin(), responses.begin() + nresponses, 0);
+	std::sort(responses.begin(), responses.begin() + nresponses,
+		[&cells](int i, int j) -> bool
+	{
+		if (cells[i].size() == 0)
+			return false;
+		if (cells[j].size() == 0)
+			return true;
+		if (cells[i].size() < cells[j].size())
+			return true;
+		if (cells[j].size() < cells[i].size())
+			return false;
+		return i < j;
+	});
+
+	// Find the number of availble responses, and skip this guess if it 
+	// generates only one response.
+	while (nresponses > 0 && cells[responses[nresponses-1]].empty())
+		--nresponses;
+	if (nresponses <= 1)
+	{
+		if (verbose)
+			std::cout << "Skipped: guess produces unit partition"
+			<< std::endl;
+		return false;
+	}
+
+	// Estimate a lower bound of the cost of revealing the secrets in 
+	// each partition, NOT counting the cost of making the initial guess.
+	// If the total lower bound reaches or exceeds the cut-off threshold,
+	// we can prune this guess.
+	// Note: this step is redundant because we have already calculated
+	// the same score before.
+	StrategyCost lb_part[256];
+	StrategyCost lb;
+	for (size_t j = 0; j < nresponses; ++j)
+	{
+		Feedback feedback = Feedback(responses[j]);
+		if (feedback != perfect)
+		{
+			lowerbound_t estimate =
+				estimator.heuristic().simple_estimate((int)cells[feedback.value()].size());
+			lb_part[j] = estimate;
+			lb += lb_part[j];
+		}
+	}
+
+	// Since this is a double-computation, we shouldn't be pruning
+	// this guess here.
+	assert(lb == score);
+	(void)score;
+
+	// Restore the cells done and the bounds of the other cells from a
+	// checkpoint.
+	size_t first_cell = 0;
+	if (restored)
+	{
+		assert(restored->lb_part.size() == nresponses);
+		std::copy(restored->lb_part.begin(), restored->lb_part.end(), lb_part);
+		lb = restored->guess_bound;
+		tree.insert_child(where, restored->guess_tree, false);
+		first_cell = restored->cells_done;
+	}
+
+	// Refine the lower bound of each cell with the colors of its secrets
+	// and with the results of solved subproblems, and prune this guess
+	// before recursing if possible.
+	else
+	{
+		for (size_t j = 0; j < nresponses; ++j)
+		{
+			const CodewordRange &cell = cells[responses[j]];
+			if (Feedback(responses[j]) == perfect || cell.size() <= 2 ||
+				cell.size() > CELL_LOWERBOUND_MAX_SIZE)
+				continue;
+			lowerbound_t estimate = estimate_cell_lowerbound(e, cell, estimator);
+			if (superior(lb_part[j], estimate))
+			{
+				lb += (estimate - lb_part[j]);
+				lb_part[j] = estimate;
+			}
+			if (estimate.depth > c.max_depth)
+			{
+				VERBOSE_COUT("Pruned guess by depth of cell lower bound.");
+				if (stats)
+					add_statistic(stats->pruned, 1ULL);
+				return false;
+			}
+		}
+
+		if (ctx.tt || ctx.store)
+		{
+			for (size_t j = 0; j < nresponses; ++j)
+			{
+				const CodewordRange &cell = cells[responses[j]];
+				if (Feedback(responses[j]) == perfect || cell.size() < TT_MIN_SIZE)
+					continue;
+				TranspositionTable::Entry entry;
+				if (ctx.probe(TranspositionTable::make_key(cell, c.max_depth), entry)
+					&& superior(lb_part[j], entry.cost))
+				{
+					lb += (entry.cost - lb_part[j]);
+					lb_part[j] = entry.cost;
+				}
+			}
+		}
+
+		if (!superior(lb, threshold))
+		{
+			VERBOSE_COUT("Pruned guess by refined lower bound.");
+			if (stats)
+				add_statistic(stats->pruned, 1ULL);
+			return false;
+		}
+	}
+
+	if (verbose)
+	{
+		std::cout << nresponses << " cells:";
+		for (size_t j = 0; j < nresponses; ++j)
+		{
+			if (j > 0)
+				std::cout << ',';
+			std::cout << cells[responses[j]].size();
+		}
+		std::cout << "; lower bound = " 	<< lb 
+			<< ", cut-off = " << threshold << std::endl;
+	}
+
+	// Find the best guess for each partition. We adopt a two-phase
+	// equivalence filtering method. First, we filter all possible
+	// codewords by (response-indepedent) constraint equivalence.
+	// This can be done once for all response classes. Then, for each
+	// individual response class, we apply the response-dependent 
+	// color equivalence filter.
+	PreFilteredGuesses pre_filtered;
+	std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
+	pre_filter->add_constraint(guess, Feedback(), e->universe());
+	// @todo we may change the interface of add_constraint to return
+	// a new filter.
+
+	// Keep track of the cells done for a checkpoint.
+	FrontierLevel *level = ctx.checkpoint_level(depth);
+	if (level)
+	{
+		level->cells_done = first_cell;
+		level->guess_bound = lb;
+		level->ncells = nresponses;
+		level->lb_part = lb_part;
+		level->guessing = true;
+		level->best_end = guess_begin;
+		level->tree_size = tree.size();
+	}
+
+	for (size_t j = first_cell; j < nresponses; ++j)
+	{
+		Feedback feedback = Feedback(responses[j]);
+		const CodewordRange &cell = cells[feedback.value()];
+
+		// Add this node to the strategy tree.
+		StrategyNode node(guess, feedback);
+		StrategyTree::iterator it = tree.insert_child(where, node);
+
+		// Do not recurse for a perfect match.
+		if (feedback == perfect)
+		{
+			VERBOSE_COUT("- Checking cell " << feedback
+				<< " -> perfect");
+			continue;
+		}
+
+		VERBOSE_COUT("- Checking cell " << feedback
+			<< " -> lower bound = " << lb_part[j]);
+
+		// Short-cut if only one additional guess is allowed
+		// but we are left with more than one secret in this
+		// partition.
+		// @todo such pruning could be improved and consolidated with
+		//  the pruning in the beginning of the routine.
+		if (c.max_depth == 1 && cell.size() > 1)
+		{
+			if (stats)
+				add_statistic(stats->cells_pruned, 1ULL);
+			return false;
+		}
+
+		// If there's an obviously optimal guess for this cell, use it.
+		StrategyCost cell_cost = fill_obviously_optimal_strategy(
+			e, cell, obj, c, tree, it);
+		if (!!cell_cost)
+		{
+			VERBOSE_COUT("  Found obvious guess");
+			if (OptimalSearchLevelStatistics *cell_stats =
+				ctx.level_statistics(depth + 1))
+				add_statistic(cell_stats->obvious, 1ULL);
+		}
+		else
+		{
+			// @todo: estimate a lower bound of the cost of any guess.
+			// If the lower bound is greater than the cut-off, we don't
+			// need to proceed any more.
+
+			// Apply constraint filter on the candidate guesses if not 
+			// already done so. This filter does not depend on the response,
+			// so a single run can be used for all response classes. Then
+			// apply color filter on the pre-filtered candidates.
+			std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
+			new_filter->add_constraint(guess, feedback, cell);
+			CodewordList canonical = get_cell_canonical_guesses(e,
+				ctx.guess_cache, secrets, pre_filter.get(), new_filter.get(),
+				c, pre_filtered);
+
+			// The cell may use up the slack left by the other cells.
+			SearchContext cell_ctx(ctx);
+			cell_ctx.shift((lb - lb_part[j]).steps);
+
+			// @todo: Check this. The minus sign doesn't work for complex
+			// cost structure.
+			cell_cost = fill_strategy_tree(e, cell, canonical,
+				pre_filter.get(), new_filter.get(), estimator, cell_ctx,
+				depth + 1, obj, c, threshold - (lb - lb_part[j]),
+				tree, it);
+		}
+
+		if (!cell_cost) // No strategy was found for this cell
+		{
+			VERBOSE_COUT("Pruned this guess because the recursion returns -1.");
+			if (stats)
+				add_statistic(stats->cells_pruned, 1ULL);
+			return false;
+		}
+
+#if 1
+		if (superior(lb_part[j], cell_cost))
+			VERBOSE_COUT("  Cell optimal cost is " << cell_cost);
+		else if (superior(cell_cost, lb_part[j]))
+			VERBOSE_COUT("  ERROR: LOWER BOUND IS HIGHER THAN ACTUAL COST.");
+		else
+			VERBOSE_COUT("  Lower bound unchanged.");
+#endif
+
+		// Refine the lower bound estimate.
+		// @bug: the lower bound estimate needs to be amended
+		lb += (cell_cost - lb_part[j]);
+		lb_part[j] = cell_cost;
+		ctx.tighten(threshold, obj);
+		if (!superior(lb, threshold))
+		{
+			VERBOSE_COUT("Skipping " << (nresponses-j-1) << " remaining "
+				<< "partitions because lower bound (" << lb << ") >= cut-off ("
+				<< threshold << ")");
+			if (stats)
+				add_statistic(stats->cells_pruned, 1ULL);
+			return false;
+		}
+
+		if (level)
+		{
+			level->cells_done = j + 1;
+			level->guess_bound = lb;
+			level->tree_size = tree.size();
+			ctx.save_checkpoint(depth);
+		}
+	}
+
+	cost = lb;
+	return true;
+}
+
+#if OPTIMAL_PARALLEL_SEARCH
+/**
+ * Searches the candidate guesses of a state in parallel, and finds the
+ * first guess in the given order that attains the optimal cost.
+ *
+ * Each guess is searched in a separate task. The tasks share the best
+ * cost found so far, which tightens the threshold of the other tasks
+ * (and of their subproblems) as soon as it improves.
+ *
+ * The arguments have the same meaning as in <code>search_guess()</code>.
+ * On return, @c best is zero if no strategy is found whose cost is lower
+ * than the threshold.
+ */
+static void search_guesses_parallel(
+	const Engine *e,
+	const CodewordList &secrets,      // remaining secrets
+	CodewordRange candidates,         // canonical guesses
+	const std::vector<int> &order,    // order in which to try the guesses
+	const StrategyCost *scores,       // lower bound of the cost of each guess
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	LowerBoundEstimator &estimator,   // lower bound estimator
+	const SearchContext &ctx,         // search-wide state
+	const int depth,                  // depth of the current state; root=0
+	StrategyObjective obj,            // objective
+	StrategyConstraints c,            // constraints
+	StrategyCost threshold,           // prunes guess if cost >= threshold
+	StrategyCost &best,               // cost of the best strategy found
+	Codeword &best_guess,             // first guess of the best strategy
+	StrategyTree &best_tree           // the best strategy found
+	)
+{
+	StrategyCostComparer superior(obj);
+	SharedBound shared;
+	size_t best_rank = order.size();
+
+	for (size_t rank = 0; rank < order.size(); ++rank)
+	{
+		#pragma omp task default(shared) firstprivate(rank)
+		{
+			size_t i = order[rank];
+			Codeword guess = candidates[i];
+
+			SearchContext task_ctx(ctx);
+			task_ctx.bounds[task_ctx.nbounds].shared = &shared;
+			task_ctx.bounds[task_ctx.nbounds].rank = rank;
+			task_ctx.bounds[task_ctx.nbounds].offset = 0;
+			++task_ctx.nbounds;
+
+			StrategyCost task_threshold = threshold;
+			task_ctx.tighten(task_threshold, obj);
+
+			if (superior(scores[i], task_threshold) &&
+				scores[i].depth <= c.max_depth)
+			{
+				CodewordList task_secrets(secrets);
+				StrategyCost cost;
+				StrategyTree this_tree(e->rules());
+				bool found = !(ctx.budget && ctx.budget->expired()) &&
+					search_guess(e, task_secrets, guess, NULL, scores[i],
+					filter1, filter2, estimator, task_ctx, depth, obj, c,
+					task_threshold, NULL, this_tree, this_tree.root(), cost);
+
+				// The search of this guess may be cut short by the budget.
+				if (depth == 0 && ctx.budget && ctx.budget->expired())
+					ctx.budget->leave_open(scores[i].steps + (unsigned int)secrets.size());
+
+				if (found)
+				{
+					#pragma omp critical (OptimalCodeBreaker_SharedBound)
+					{
+						if (!best || superior(cost, best) ||
+							(!superior(best, cost) && rank < best_rank))
+						{
+							best = cost;
+							best_rank = rank;
+							best_guess = guess;
+							std::swap(this_tree, best_tree);
+							shared.update(best.steps, best_rank);
+						}
+					}
+				}
+			}
+		}
+	}
+	#pragma omp taskwait
+}
+#endif
+
+#if OPTIMAL_DISTRIBUTED_SEARCH
+/**
+ * Worker processes connected to the coordinator of a distributed search.
+ * Each worker runs <code>serve_optimal_search()</code>, and searches the
+ * candidate guesses of the root sent to it one at a time.
+ */
+class WorkerPool
+{
+	std::vector<std::unique_ptr<MessageChannel>> _workers;
+
+public:
+
+	/// Waits for the given number of workers to connect to the address.
+	/// Throws <code>std::runtime_error</code> if a worker does not connect
+	/// within WORKER_CONNECT_TIMEOUT seconds, e.g. because it exited, or
+	/// does not search with the rules, objective and constraints in
+	/// @c header.
+	WorkerPool(const std::string &address, size_t count,
+		const std::string &header)
+	{
+		MessageListener listener(address);
+		for (size_t k = 0; k < count; ++k)
+		{
+			std::unique_ptr<MessageChannel> worker(
+				listener.accept(WORKER_CONNECT_TIMEOUT));
+			if (!worker)
+			{
+				std::ostringstream msg;
+				msg << "only " << k << " of " << count << " workers connected "
+					<< "within " << WORKER_CONNECT_TIMEOUT << " seconds";
+				throw std::runtime_error(msg.str());
+			}
+			std::string hello;
+			if (!worker->receive(hello) || hello != header)
+				throw std::runtime_error("a worker was started with different "
+					"rules or options than the coordinator");
+			_workers.push_back(std::move(worker));
+		}
+	}
+
+	/// Tells the workers to exit.
+	~WorkerPool()
+	{
+		for (size_t k = 0; k < _workers.size(); ++k)
+		{
+			if (_workers[k])
+				_workers[k]->send("quit");
+		}
+	}
+
+	/// Returns the number of workers, including those disconnected.
+	size_t size() const { return _workers.size(); }
+
+	/// Returns the channel to a worker, or @c NULL if it is disconnected.
+	MessageChannel * worker(size_t k) const { return _workers[k].get(); }
+
+	/// Closes the channel to a worker that failed.
+	void disconnect(size_t k) { _workers[k].reset(); }
+};
+
+/**
+ * Searches the candidate guesses of the root on the worker processes,
+ * and finds the first one in the given order that attains the optimal
+ * cost, as <code>search_guesses_parallel()</code> does.
+ *
+ * Each guess is sent as a job to an idle worker together with the
+ * threshold at that time. When a worker reports a better strategy, the
+ * best cost is broadcast to all workers, where it tightens the threshold
+ * of the guesses being searched. If a worker disconnects, its job is
+ * sent to another worker.
+ */
+static void search_guesses_distributed(
+	WorkerPool &pool,                 // worker processes
+	CodewordRange candidates,         // canonical guesses
+	const std::vector<int> &order,    // order in which to try the guesses
+	const StrategyCost *scores,       // lower bound of the cost of each guess
+	const SearchContext &ctx,         // search-wide state
+	StrategyObjective obj,            // objective
+	StrategyConstraints c,            // constraints
+	StrategyCost threshold,           // prunes guess if cost >= threshold
+	StrategyCost &best,               // cost of the best strategy found
+	Codeword &best_guess,             // first guess of the best strategy
+	StrategyTree &best_tree           // the best strategy found
+	)
+{
+	StrategyCostComparer superior(obj);
+	SharedBound shared;
+	const size_t idle = order.size();
+	size_t best_rank = order.size();
+
+	// Rank of the guess searched by each worker, and the guesses to send
+	// again because their worker disconnected.
+	std::vector<size_t> job(pool.size(), idle);
+	std::vector<size_t> retry;
+	size_t next = 0, running = 0;
+
+	for (;;)
+	{
+		// Send a guess to each idle worker, skipping the guesses that are
+		// pruned by the best cost so far.
+		for (size_t k = 0; k < pool.size(); ++k)
+		{
+			while (pool.worker(k) && job[k] == idle &&
+				(!retry.empty() || next < order.size()))
+			{
+				size_t rank;
+				if (!retry.empty())
+				{
+					rank = retry.back();
+					retry.pop_back();
+				}
+				else
+				{
+					rank = next++;
+				}
+				size_t i = order[rank];
+
+				SearchContext task_ctx(ctx);
+				task_ctx.bounds[task_ctx.nbounds].shared = &shared;
+				task_ctx.bounds[task_ctx.nbounds].rank = rank;
+				task_ctx.bounds[task_ctx.nbounds].offset = 0;
+				++task_ctx.nbounds;
+
+				StrategyCost task_threshold = threshold;
+				task_ctx.tighten(task_threshold, obj);
+				if (!(superior(scores[i], task_threshold) &&
+					scores[i].depth <= c.max_depth))
+					continue;
+
+				std::ostringstream os;
+				os << "job " << rank << ' ' << candidates[i].pack();
+				write_cost(os, scores[i]);
+				os << ' ' << (int)c.max_depth;
+				write_cost(os, task_threshold);
+				if (pool.worker(k)->send(os.str()))
+				{
+					job[k] = rank;
+					++running;
+				}
+				else
+				{
+					retry.push_back(rank);
+					pool.disconnect(k);
+				}
+			}
+		}
+
+		if (running == 0)
+		{
+			if (retry.empty() && next == order.size())
+				break;
+			throw std::runtime_error("all workers of the distributed search "
+				"have disconnected");
+		}
+
+		// Wait for a worker to report the result of its guess.
+		std::vector<MessageChannel *> channels;
+		std::vector<size_t> busy;
+		for (size_t k = 0; k < pool.size(); ++k)
+		{
+			if (pool.worker(k) && job[k] != idle)
+			{
+				channels.push_back(pool.worker(k));
+				busy.push_back(k);
+			}
+		}
+		size_t k = busy[MessageChannel::wait(channels)];
+		size_t rank = job[k];
+		job[k] = idle;
+		--running;
+
+		std::string message;
+		std::istringstream is;
+		std::string type;
+		size_t result_rank;
+		int found;
+		StrategyCost cost;
+		StrategyTree tree(best_tree.rules());
+		if (pool.worker(k)->receive(message))
+			is.str(message);
+		if (!((is >> type >> result_rank >> found) && type == "result" &&
+			result_rank == rank && read_cost(is, cost) &&
+			(!found || read_tree_nodes(is, tree))))
+		{
+			std::cerr << "Warning: lost a worker of the distributed search."
+				<< std::endl;
+			retry.push_back(rank);
+			pool.disconnect(k);
+			continue;
+		}
+
+		if (found && (!best || superior(cost, best) ||
+			(!superior(best, cost) && rank < best_rank)))
+		{
+			best = cost;
+			best_rank = rank;
+			best_guess = candidates[order[rank]];
+			std::swap(tree, best_tree);
+			shared.update(best.steps, best_rank);
+
+			std::ostringstream os;
+			os << "bound " << best.steps << ' ' << best_rank;
+			for (size_t j = 0; j < pool.size(); ++j)
+			{
+				if (pool.worker(j))
+					pool.worker(j)->send(os.str());
+			}
+		}
+	}
+}
+#endif
+
+/**
+ * Searches for an optimal strategy for the given set of remaining secrets.
+ *
+ * @param depth Depth of the current state. This is equal to the number of 
+ *      guesses already made.
+ * @param threshold Branch pruning threshold. If the cost of revealing all
+ *      the secrets would reach or exceed this threshold, the function will
+ *      fail. This parameter should be set to the currently best cost achieved
+ *      by some known strategy.
+ * @returns The cost of the optimal strategy if one is found, or zero if 
+ *      one is not found either because some secret would require more than
+ *      <code>c.max_depth</code> guesses to reveal, or because the cost of
+ *      any strategy would reach or exceed the cut-off threshold.
+ *
+ * Among the guesses that attain the optimal cost, the function returns the
+ * first one in the order the candidates are searched. Since each candidate
+ * starts from the same order of the secrets, the strategy found does not
+ * depend on the threshold, nor on whether the candidates are searched in
+ * parallel.
+ *
+ * @todo Add progress report (0% - 100%)
+ */
+// @todo: We might change the equivalence filter interface to operate on
+// the input inplace? This could save a few memory copies but may change
+// the output.
+// all the secrets, or -1 if such optimal will not be less than _best_.
+static StrategyCost fill_strategy_tree(
+	const Engine *e,
+	CodewordRange secrets,            // remaining secrets; will be partitioned
+	CodewordRange candidates,         // canonical guesses; may be sorted
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	LowerBoundEstimator &estimator,   // lower bound estimator
+	const SearchContext &ctx,         // search-wide state
+	const int depth,                  // depth of the current state; root=0
+	StrategyObjective obj,            // objective
+	StrategyConstraints c,            // constraints
+	StrategyCost threshold,           // prunes branch if cost >= threshold
+	StrategyTree &tree,               // tree to store the strategy found
+	StrategyTree::iterator where      // iterator to the current state
+	)
+{
+	UPDATE_CALL_COUNTER("OptimalRecursion", (int)secrets.size());
+
+	bool verbose = false; // (depth < 1);
+
+	OptimalSearchLevelStatistics *stats = ctx.level_statistics(depth);
+	StateTimer timer(stats);
+	if (stats)
+		add_statistic(stats->states, 1ULL);
+
+	VERBOSE_COUT("Checking " << secrets.size() << " remaining secrets");
+
+	// Fail if the secret set is empty or the max-depth is 0.
+	if (secrets.empty() || c.max_depth == 0)
+		return StrategyCost();
+
+	// Fail if the budget has run out.
+	if (ctx.budget && ctx.budget->enter())
+		return StrategyCost();
+
+	// Initialize common variables.
+	const unsigned int nsecrets = (int)secrets.size();
+
+	// Short-cut if there is only one secret.
+	if (nsecrets == 1)
+	{
+		const Feedback perfect = Feedback::perfectValue(e->rules());
+		tree.insert_child(where, StrategyNode(secrets[0], perfect));
+		return StrategyCost(1, 1, 1);
+	}
+
+	// Candidates of the top levels are searched in parallel.
+	const bool parallel = (OPTIMAL_PARALLEL_SEARCH &&
+		depth < ctx.parallel_depth &&
+		depth < MAX_PARALLEL_DEPTH && candidates.size() > 1);
+
+	// Look up the transposition table and the persistent store. If the
+	// subproblem has been solved before, either fail right away if the
+	// known cost (or lower bound) reaches the threshold, or replay the
+	// known best guess. In a parallel search the content of the table
+	// depends on timing, so a known cost is only used to tighten the
+	// threshold, which keeps the result deterministic.
+	TranspositionTable::Key tt_key;
+	StrategyCost tt_bound;
+	CodewordList tt_replay;
+	const bool use_tt = ((ctx.tt != NULL || ctx.store != NULL) &&
+		nsecrets >= TT_MIN_SIZE);
+
+	// The top levels of the search path are saved in a checkpoint. If the
+	// search is resumed, restore the level saved for this state, including
+	// the result of looking up the table when the state was first entered.
+	FrontierLevel *level = ctx.checkpoint_level(depth);
+	const SavedLevel *restored = NULL;
+	if (use_tt || level)
+		tt_key = TranspositionTable::make_key(secrets, c.max_depth);
+	if (level)
+		restored = ctx.checkpoint->restore(depth, tt_key);
+
+	if (restored)
+	{
+		tt_bound = restored->tt_bound;
+		if (restored->replay)
+		{
+			tt_replay.push_back(restored->replay_guess);
+			candidates = tt_replay;
+		}
+	}
+	else if (use_tt)
+	{
+		TranspositionTable::Entry entry;
+		if (ctx.probe(tt_key, entry))
+		{
+			if (!superior(entry.cost, threshold, obj))
+				return StrategyCost();
+			if (entry.type == TranspositionTable::LowerBound)
+			{
+				tt_bound = entry.cost;
+			}
+			else if (ctx.parallel_depth == 0)
+			{
+				tt_replay.push_back(Codeword::unpack(entry.guess));
+				candidates = tt_replay;
+			}
+			else if (threshold.steps > entry.cost.steps + 1)
+			{
+				threshold.steps = entry.cost.steps + 1;
+			}
+		}
+	}
+
+	// Seed the threshold with the cost of a heuristic strategy, so that
+	// the candidates can be pruned before a good strategy is found by the
+	// search. The threshold is one step above the cost, so that the search
+	// still finds the same strategy; it always finds one because the
+	// heuristic strategy is among the strategies searched. The root of an
+	// anytime search is already seeded.
+	if (ctx.seed_strategy && nsecrets >= ctx.seed_size &&
+		obj == MinSteps && tt_replay.empty() && !(depth == 0 && ctx.budget))
+	{
+		// Partition a copy of the secrets, whose order affects the result.
+		CodewordList copy(secrets.begin(), secrets.end());
+		StrategyCost seed = heuristic_strategy_cost(e, copy, candidates,
+			filter1, filter2, ctx.seed_strategy, ctx.guess_cache, obj, c);
+		UPDATE_CALL_COUNTER("OptimalSeed", (int)nsecrets);
+		if (!!seed && threshold.steps > seed.steps + 1)
+			threshold.steps = seed.steps + 1;
+	}
+
+	// From now on, we will need to make at least one guess to reveal any 
+	// secret, and at least two guesses to reveal all secrets. This accounts
+	// for n total steps and 1 extra step. 
+	
+	// Update the constraints and threshold so that they will apply to a 
+	// situation after the initial guess.
+	if (c.max_depth == 1)
+		return StrategyCost();
+	else
+		--c.max_depth;
+
+	if (threshold.steps <= nsecrets)
+		return StrategyCost();
+	else
+		threshold.steps -= nsecrets;
+
+	// @bug The following criteria is problematic.
+	if (threshold.depth <= 1)
+		return StrategyCost();
+	else
+		--threshold.depth;
+
+	SearchContext sub_ctx(ctx);
+	sub_ctx.shift(nsecrets);
+
+	// Define a strategy cost comparer.
+	StrategyCostComparer superior(obj);
+
+#if 0
+	// If find_last is true, then we only cut-off a guess when it's
+	// strictly worse than the current best; otherwise, we cut-off
+	// a guess as long as it's no better than the current best.
+	int cut_off_delta = (c.find_last? 1 : 0);
+	cut_off += cut_off_delta ???
+#endif
+
+	// Filter canonical guesses as candidates.
+	//CodewordList candidates = filter->get_canonical_guesses(e.universe());
+	//VERBOSE_COUT("Found " << candidates.size() << " canonical guesses.");
+
+	// Compute a lower bound of the cost for each candidate guess, exluding
+	// the cost of making the initial guess because this is the same for all
+	// candidates. Then sort the candidates by this lower bound so that more
+	// "promising" candidates are processed first. This helps to improve the
+	// upper bound as early as possible.
+	// @todo It might be better to rename scores to extra_cost.
+	typedef Heuristics::MinimizeLowerBound::score_t lowerbound_t;
+	std::vector<lowerbound_t> scores(candidates.size());
+	//estimator.make_guess(secrets, candidates, scores.data());
+	estimator.evaluate(secrets, candidates, scores.data());
+
+	// @todo We might opt to remove the need to create an index array.
+	// Instead, we could scan for the element in each iteration.
+	std::vector<int> order(candidates.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	// Define SORT_CANDIDATES to 1 to explicitly sort the candidate guesses.
+	// Since many guesses will be pruned right away (especially if we have
+	// a good estimate of the lower-bound of the cost), it is usually faster
+	// to select the smallest element from a heap in each iteration, instead
+	// of sorting the whole array at the beginning. Note that the sort breaks
+	// ties by index, while the selection breaks them by position after the
+	// swaps, so the results may differ.
+#define SORT_CANDIDATES 0
+
+#if SORT_CANDIDATES
+	std::sort(order.begin(), order.end(), [&](int i, int j) -> bool {
+		if (superior(scores[i], scores[j]))
+			return true;
+		if (superior(scores[j], scores[i]))
+			return false;
+		return i < j;
+	});
+#endif
+
+	// Finds the guess with the lowest estimated cost in the remaining
+	// candidates, and swaps it to the front.
+#if !SORT_CANDIDATES
+	CandidateQueue queue(order, scores.data(), obj);
+#endif
+	auto select_candidate = [&](size_t index)
+	{
+#if !SORT_CANDIDATES
+		queue.select(index);
+#else
+		(void)index;
+#endif
+	};
+
+	// Initialize state variables to store the best guess and its cost so far.
+	StrategyCost best;
+	Codeword best_guess;
+
+	// The strategy of each candidate guess is built in place as children
+	// of the current state. The nodes of the best strategy found so far
+	// start at position 'mark' and end at position 'best_end'; the nodes
+	// of the guess being tried follow them. The nodes of a guess that
+	// is pruned are rolled back, and those of a guess that improves the
+	// best strategy replace it. Hence no node is copied unless a better
+	// guess is found.
+	const size_t mark = tree.size();
+	size_t best_end = mark;
+
+	// Skip the guesses done before the checkpoint was saved.
+	size_t first = 0;
+	if (restored)
+	{
+		first = restored->rank;
+		best = restored->best;
+		best_guess = restored->best_guess;
+		tree.insert_child(where, restored->best_tree, false);
+		best_end = tree.size();
+		if (!!best)
+		{
+			if (obj == MinSteps)
+				threshold.steps = best.steps;
+			else
+				threshold = best;
+		}
+	}
+	if (level)
+	{
+		level->key = tt_key;
+		level->replay = !tt_replay.empty();
+		level->replay_guess = tt_replay.empty()? Codeword() : tt_replay[0];
+		level->tt_bound = tt_bound;
+		level->best = best;
+		level->best_guess = best_guess;
+		level->tree = &tree;
+		level->where = where;
+		level->mark = mark;
+		level->best_end = best_end;
+		level->guessing = false;
+	}
+
+	// Each candidate guess partitions the secrets starting from the same
+	// order, so that the result does not depend on the guesses searched
+	// before it.
+	CodewordList initial_order;
+	if (candidates.size() > 1)
+		initial_order.assign(secrets.begin(), secrets.end());
+	PartitionSet partitions(e, initial_order);
+
+	// Try each candidate guess. Keep track of the position of the first
+	// guess searched and of the best guess in the order of the candidates.
+	size_t candidate_count = candidates.size();
+	size_t first_tried = candidate_count, best_index = candidate_count;
+	if (!parallel)
+	{
+		for (size_t index = 0; index < candidate_count; ++index)
+		{
+			select_candidate(index);
+			if (index < first)
+				continue;
+			size_t i = order[index];
+			Codeword guess = candidates[i];
+
+			// Since we keep improving the upper bound dynamically,
+			// and we sort the candidates by their lower bound,
+			// we need to check here whether the remaining candidates
+			// are still worth checking.
+			sub_ctx.tighten(threshold, obj);
+			if (!superior(scores[i], threshold))
+			{
+				VERBOSE_COUT("Pruned " << (candidate_count - index)
+					<< " remaining guesses: lower bound (" << scores[i]
+					<< ") >= cut-off (" << threshold << ")");
+				break;
+			}
+
+			VERBOSE_COUT("Checking guess " << (i+1) << " of "
+				<< candidate_count << " (" << guess << ") -> ");
+
+			// If there's a limit on the maximum number of guesses allowed,
+			// check if we can prune it.
+			if (scores[i].depth > c.max_depth)
 			{
-				VERBOSE_COUT("- Checking cell " << feedback
-					<< " -> perfect");
+				if (verbose)
+					std::cout << "Skipped: guess will have too many steps"
+					<< std::endl;
 				continue;
 			}
 
-			VERBOSE_COUT("- Checking cell " << feedback
-				<< " -> lower bound = " << lb_part[j]);
+			// Skip the guess if another guess tried before induces the same
+			// partition of the secrets.
+			if (!partitions.insert(guess))
+			{
+				UPDATE_CALL_COUNTER("OptimalDuplicatePartition", nsecrets);
+				continue;
+			}
+
+			if (index > 0)
+				std::copy(initial_order.begin(), initial_order.end(), secrets.begin());
+
+			// Resume the guess being tried when the checkpoint was saved.
+			const SavedLevel *restored_guess = (restored && index == first &&
+				!restored->lb_part.empty())? restored : NULL;
+			if (level)
+				level->rank = index;
+
+			if (first_tried == candidate_count)
+				first_tried = index;
+
+			// The partition set has just compared the guess to the secrets
+			// in their initial order, so reuse the responses.
+			FeedbackList *feedbacks = initial_order.empty()?
+				NULL : &partitions.feedbacks();
+			StrategyCost cost;
+			bool found = search_guess(e, secrets, guess, feedbacks, scores[i],
+				filter1, filter2, estimator, sub_ctx, depth, obj, c, threshold,
+				restored_guess, tree, where, cost);
+			if (!found)
+				tree.rollback(best_end);
+
+			// Stop trying more guesses if the budget has run out.
+			// The search of this guess may have been cut short, so its
+			// cost is not proven at the root.
+			if (ctx.budget && ctx.budget->expired())
+			{
+				if (depth == 0)
+					ctx.budget->leave_open(scores[i].steps + nsecrets);
+				if (!found)
+					break;
+			}
+			if (found)
+			{
+				// Now the guess is the best guess so far.
+				assert(superior(cost, threshold));
+				assert(!best || superior(cost, best));
+				best = cost;
+				best_guess = guess;
+				best_index = index;
+
+				// Only tighten the components of the threshold that are part
+				// of the objective. In particular, under MinSteps the depth of
+				// the best strategy so far must not restrict the depth of the
+				// remaining candidates; otherwise the result of the search
+				// would depend on the initial threshold.
+				if (obj == MinSteps)
+					threshold.steps = best.steps;
+				else
+					threshold = best;
+				VERBOSE_COUT("Improved cut-off to " << best);
 
-			// Short-cut if only one additional guess is allowed
-			// but we are left with more than one secret in this
-			// partition.
-			// @todo such pruning could be improved and consolidated with
-			//  the pruning in the beginning of the routine.
-			if (c.max_depth == 1 && cell.size() > 1)
+				// Replace the previous best strategy with this one.
+				UPDATE_CALL_COUNTER("OptimalTree_Replace", (unsigned int)(best_end - mark));
+				tree.erase(mark, best_end);
+				best_end = tree.size();
+			}
+
+			if (level)
+			{
+				level->rank = index + 1;
+				level->best = best;
+				level->best_guess = best_guess;
+				level->best_end = best_end;
+				level->guessing = false;
+				sub_ctx.save_checkpoint(depth);
+			}
+		}
+	}
+#if OPTIMAL_PARALLEL_SEARCH
+	else
+	{
+		// Fix the order in which the serial search would try the
+		// candidates. The best guess is the first one in this order
+		// that attains the optimal cost.
+		for (size_t index = 0; index < candidate_count; ++index)
+			select_candidate(index);
+
+		// Remove the guesses whose partition of the secrets is the same
+		// as that of a guess before them.
+		order.erase(std::remove_if(order.begin(), order.end(),
+			[&](int i) -> bool { return !partitions.insert(candidates[i]); }),
+			order.end());
+
+		// The guesses are searched in separate trees, and the best
+		// strategy is appended to the tree at the end.
+		StrategyTree best_tree(e->rules());
+#if OPTIMAL_DISTRIBUTED_SEARCH
+		if (ctx.workers && depth == 0)
+			search_guesses_distributed(*ctx.workers, candidates, order,
+				scores.data(), sub_ctx, obj, c, threshold, best, best_guess,
+				best_tree);
+		else
+#endif
+		search_guesses_parallel(e, initial_order, candidates, order,
+			scores.data(), filter1, filter2, estimator, sub_ctx, depth, obj,
+			c, threshold, best, best_guess, best_tree);
+		if (!!best)
+			tree.insert_child(where, best_tree, false);
+		else
+			sub_ctx.tighten(threshold, obj);
+
+		first_tried = 0;
+		for (size_t index = 0; index < order.size(); ++index)
+		{
+			if (!!best && candidates[order[index]] == best_guess)
 			{
-				pruned = true;
+				best_index = index;
 				break;
 			}
+		}
+	}
+#endif
+
+	// The cut-off of a guess searched in parallel at an ancestor may have
+	// pruned the guesses here against a threshold below the best cost
+	// found, in which case that cost is not proven optimal. Since these
+	// cut-offs only get tighter, it suffices to check the current one.
+	bool proven = true;
+	if (!!best)
+	{
+		StrategyCost limit = best;
+		sub_ctx.tighten(limit, obj);
+		proven = (limit.steps >= best.steps);
+	}
+
+	// Count how often the first guess searched turns out to be the best.
+	if (stats && !!best && candidate_count > 1)
+	{
+		add_statistic(stats->solved, 1ULL);
+		if (best_index == first_tried)
+			add_statistic(stats->first_best, 1ULL);
+	}
+
+	// If a best strategy was found, it is already in the tree. Since
+	// 'best' is calculated without accounting for the initial guess, we
+	// need to add it back.
+	if (!!best)
+	{
+		best.steps += nsecrets;
+		++best.depth;
+		// best.worst;
+	}
+
+	// Store the result in the transposition table. If no strategy is
+	// found, the threshold is a lower bound of the cost. A search that
+	// replays a known guess proves nothing about the other guesses, and
+	// neither does a search cut short by the budget or by an external
+	// cut-off.
+	if (use_tt && !(ctx.budget && ctx.budget->expired()))
+	{
+		if (!!best)
+		{
+			if (proven)
+				ctx.record(tt_key, TranspositionTable::Exact, best,
+					best_guess, nsecrets);
+		}
+		else if (tt_replay.empty())
+		{
+			StrategyCost bound = threshold;
+			bound.steps += nsecrets;
+			if (superior(bound, tt_bound))
+				bound = tt_bound;
+			ctx.record(tt_key, TranspositionTable::LowerBound, bound,
+				Codeword(), nsecrets);
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Computes an upper bound of the number of secrets that any strategy
+ * reveals within @c d guesses, for each @c d until the bound covers all
+ * secrets.
+ *
+ * A strategy for a set of secrets also plays a superset of the secrets,
+ * revealing each secret in the set by the same guesses. Hence a bound
+ * for all secrets also bounds any set of remaining secrets. The bound
+ * for @c d guesses is the maximum, over the canonical initial guesses,
+ * of the sum over the cells of the size of the cell capped by the bound
+ * for <code>d-1</code> guesses. If the game is small, the cells are
+ * further expanded by the canonical second guesses.
+ */
+static std::vector<unsigned int> compute_max_breakable(const Engine *e)
+{
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const unsigned int total = (unsigned int)e->rules().size();
+	const bool expand = (total <= MAX_BREAKABLE_LOOKAHEAD_SIZE);
+
+	// The partition of a set of secrets by a guess: whether the guess is
+	// one of the secrets, and the size of the other cells.
+	struct Split
+	{
+		unsigned int hit;
+		std::vector<unsigned int> sizes;
+	};
 
-			// If there's an obviously optimal guess for this cell, use it.
-			// @todo "mastermind -v -s optimal -r mm -md 5" doesn't
-			// respect the "-md 5" option.
-			StrategyCost cell_cost = fill_obviously_optimal_strategy(
-				e, cell, obj, c, this_tree, it);
-			if (!!cell_cost)
-			{
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> found obvious guess");
-				VERBOSE_COUT("  Found obvious guess");
-			}
-			else
-			{
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> lower bound = " << lb);
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> lower bound = " << lb_part[j]);
+	// The cells of each initial guess, and the partition of each cell by
+	// each canonical second guess.
+	struct Cell
+	{
+		unsigned int size;
+		std::vector<Split> splits;
+	};
 
-				// @todo: estimate a lower bound of the cost of any guess.
-				// If the lower bound is greater than the cut-off, we don't
-				// need to proceed any more.
+	CompositeEquivalenceFilter filter(
+		CreateConstraintEquivalenceFilter(e),
+		CreateResponseEquivalenceFilter(e, StrategyConstraints()));
+	CodewordList initial = get_initial_guesses(e, filter);
 
-				// Apply constraint filter on the candidate guesses if not 
-				// already done so. This filter does not depend on the response,
-				// so a single run can be used for all response classes.
-				if (pre_filtered.empty())
-				{
-					if (c.pos_only)
-						pre_filtered = pre_filter->get_canonical_guesses(secrets);
-					else
-						pre_filtered = pre_filter->get_canonical_guesses(e->universe());
-				}
+	std::vector<Split> first(initial.size());
+	std::vector<std::vector<Cell>> cells(initial.size());
+	for (size_t i = 0; i < initial.size(); ++i)
+	{
+		Codeword guess = initial[i];
+		CodewordList secrets = e->generateCodewords();
+		CodewordPartition partition = e->partition(secrets, guess);
 
-				// Apply color filter on the pre-filtered candidates.
-				std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
-				new_filter->add_constraint(guess, feedback, cell);
-				CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
+		std::unique_ptr<EquivalenceFilter> pre_filter(filter.first()->clone());
+		pre_filter->add_constraint(guess, Feedback(), e->universe());
+		CodewordList pre_filtered;
+		if (expand)
+			pre_filtered = pre_filter->get_canonical_guesses(e->universe());
 
-				// @todo: Check this. The minus sign doesn't work for complex
-				// cost structure.
-				cell_cost = fill_strategy_tree(e, cell, canonical,
-					pre_filter.get(), new_filter.get(), estimator,
-					depth + 1, obj, c, threshold - (lb - lb_part[j]),
-					this_tree, it);
-			}
+		first[i].hit = (unsigned int)partition[perfect.value()].size();
+		for (size_t j = 0; j < partition.size(); ++j)
+		{
+			Feedback feedback = Feedback(j);
+			CodewordRange cell = partition[j];
+			if (feedback == perfect || cell.empty())
+				continue;
 
-			if (!cell_cost) // No strategy was found for this cell
+			Cell info;
+			info.size = (unsigned int)cell.size();
+			if (expand && cell.size() > 1)
 			{
-				VERBOSE_COUT("Pruned this guess because the recursion returns -1.");
-				pruned = true;
-				break;
+				std::unique_ptr<EquivalenceFilter> new_filter(filter.second()->clone());
+				new_filter->add_constraint(guess, feedback, cell);
+				CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
+				for (size_t k = 0; k < canonical.size(); ++k)
+				{
+					FeedbackFrequencyTable freq = e->compare(canonical[k], cell);
+					Split split;
+					split.hit = freq[perfect.value()];
+					for (size_t m = 0; m < freq.size(); ++m)
+					{
+						if (freq[m] > 0 && Feedback(m) != perfect)
+							split.sizes.push_back(freq[m]);
+					}
+					info.splits.push_back(split);
+				}
 			}
+			cells[i].push_back(info);
+		}
+	}
 
-#if 1
-			if (superior(lb_part[j], cell_cost))
-				VERBOSE_COUT("  Cell optimal cost is " << cell_cost);
-			else if (superior(cell_cost, lb_part[j]))
-				VERBOSE_COUT("  ERROR: LOWER BOUND IS HIGHER THAN ACTUAL COST.");
-			else
-				VERBOSE_COUT("  Lower bound unchanged.");
-#endif
-
-			// Refine the lower bound estimate.
-			// @bug: the lower bound estimate needs to be amended
-			lb += (cell_cost - lb_part[j]);
-			lb_part[j] = cell_cost;
-			if (!superior(lb, threshold))
+	// Build the table level by level.
+	std::vector<unsigned int> f(2);
+	f[0] = 0;
+	f[1] = 1;
+	while (f.back() < total)
+	{
+		size_t d = f.size();
+		unsigned int best = 0;
+		for (size_t i = 0; i < initial.size(); ++i)
+		{
+			unsigned int sum = first[i].hit;
+			for (size_t j = 0; j < cells[i].size(); ++j)
 			{
-				VERBOSE_COUT("Skipping " << (nresponses-j-1) << " remaining "
-					<< "partitions because lower bound (" << lb << ") >= best ("
-					<< best << ")");
-				pruned = true;
-				break;
+				const Cell &cell = cells[i][j];
+				unsigned int r = f[d-1];
+				if (!cell.splits.empty())
+				{
+					r = 0;
+					for (size_t k = 0; k < cell.splits.size(); ++k)
+					{
+						const Split &split = cell.splits[k];
+						unsigned int count = split.hit;
+						for (size_t m = 0; m < split.sizes.size(); ++m)
+							count += std::min(split.sizes[m], f[d-2]);
+						r = std::max(r, count);
+					}
+				}
+				sum += std::min(cell.size, r);
 			}
+			best = std::max(best, sum);
 		}
+		assert(best > f.back());
+		f.push_back(std::max(best, f.back() + 1));
+	}
+	return f;
+}
 
-		// Now the guess is either pruned, or is the best guess so far.
-		if (!pruned)
-		{
-			assert(superior(lb, threshold));
-			assert(!best || superior(lb, best));
-			best = lb;
-			threshold = best;
-			VERBOSE_COUT("Improved cut-off to " << best);
+/**
+ * Returns the table of the maximum number of secrets that any strategy
+ * reveals within a given number of guesses. The table is computed once
+ * for each set of rules.
+ */
+static std::vector<unsigned int> max_breakable_table(const Engine *e)
+{
+	static std::map<int, std::vector<unsigned int>> cache;
 
-			// Use this_tree as best_tree.
-			// @todo: optimize swap()
-			std::swap(this_tree, best_tree);
-		}
+	const Rules &rules = e->rules();
+	int key = (rules.pegs() * 100 + rules.colors()) * 2 + (rules.repeatable()? 1 : 0);
+	std::vector<unsigned int> f;
+	#pragma omp critical (OptimalCodeBreaker_MaxBreakable)
+	{
+		std::map<int, std::vector<unsigned int>>::const_iterator it = cache.find(key);
+		if (it == cache.end())
+			it = cache.insert(std::make_pair(key, compute_max_breakable(e))).first;
+		f = it->second;
 	}
+	return f;
+}
 
-	// If a best strategy was found, append the strategy to the tree.
-	// Also, since 'best' is calculated without accounting for the initial
-	// guess, we need to add it back.
-	if (!!best)
+/**
+ * Creates the transposition table and the cache of canonical guesses as
+ * requested by the options, and sets them in a search context. The table
+ * is only created if the results of the search are exact, i.e. only
+ * depend on the secrets of a cell; the canonical guesses always are.
+ */
+template <class Context>
+static void create_caches(
+	const OptimalSearchOptions &options,
+	bool exact,
+	Context &ctx,
+	std::unique_ptr<TranspositionTable> &tt,
+	std::unique_ptr<CanonicalGuessCache> &guess_cache)
+{
+	if (options.tt_size > 0 && exact)
 	{
-		tree.insert_child(where, best_tree, false);
-		best.steps += nsecrets;
-		++best.depth;
-		// best.worst;
+		tt.reset(new TranspositionTable(options.tt_size << 20));
+		ctx.tt = tt.get();
+	}
+	if (options.guess_cache_size > 0)
+	{
+		guess_cache.reset(new CanonicalGuessCache(options.guess_cache_size << 20));
+		ctx.guess_cache = guess_cache.get();
 	}
+}
 
-	return best;
+/**
+ * Creates the caches of the MinSteps search and opens the persistent
+ * store of solved subproblems. The cached results are only exact for the
+ * MinSteps objective. No result is cached if the guesses are restricted
+ * to the secrets, because the candidate guesses of a cell are then the
+ * secrets of its parent, so its cost depends on the path to it and not
+ * only on its secrets. The records of the store are only used by searches
+ * with the same objective and the same constraints, except for the
+ * maximum depth, which is part of the key of each subproblem.
+ */
+static void create_caches(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options,
+	SearchContext &ctx,
+	std::unique_ptr<TranspositionTable> &tt,
+	std::unique_ptr<CanonicalGuessCache> &guess_cache,
+	std::unique_ptr<SubproblemStore> &store)
+{
+	bool exact = (obj == MinSteps && !constraints.pos_only);
+	create_caches(options, exact, ctx, tt, guess_cache);
+	if (!options.store_file.empty() && exact)
+	{
+		uint8_t tag = (uint8_t)((int)obj | (constraints.use_obvious? 8 : 0));
+		store.reset(new SubproblemStore(options.store_file, e->rules(), tag));
+		ctx.store = store.get();
+	}
+}
+
+/// Returns a line that identifies the rules, objective and constraints of
+/// a search, which must be the same for all processes of a distributed
+/// search and for a search resumed from a checkpoint.
+static std::string search_header(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints)
+{
+	std::ostringstream header;
+	header << "rules " << e->rules().pegs() << ' ' << e->rules().colors()
+		<< ' ' << e->rules().repeatable() << " objective " << (int)obj
+		<< " constraints " << (int)constraints.max_depth << ' '
+		<< constraints.pos_only << ' ' << constraints.use_obvious;
+	return header.str();
+}
+
+/// Writes the statistics of the states at one depth, or of all depths, as
+/// the members of a JSON object.
+static void write_level_json(std::ostream &os,
+	const OptimalSearchLevelStatistics &s, const char *indent)
+{
+	os << indent << "\"states\": " << s.states << ",\n"
+		<< indent << "\"candidates\": " << s.candidates << ",\n"
+		<< indent << "\"pruned_by_bound\": " << s.pruned << ",\n"
+		<< indent << "\"pruned_midway\": " << s.cells_pruned << ",\n"
+		<< indent << "\"obvious\": " << s.obvious << ",\n"
+		<< indent << "\"solved\": " << s.solved << ",\n"
+		<< indent << "\"first_best\": " << s.first_best << ",\n"
+		<< indent << "\"first_best_rate\": "
+		<< (s.solved? (double)s.first_best / s.solved : 0.0) << ",\n"
+		<< indent << "\"seconds\": " << s.seconds << "\n";
+}
+
+void OptimalSearchStatistics::write_json(std::ostream &os) const
+{
+	OptimalSearchLevelStatistics total;
+	os << "{\n  \"levels\": [";
+	for (size_t d = 0; d < levels.size(); ++d)
+	{
+		const OptimalSearchLevelStatistics &s = levels[d];
+		os << (d > 0? ",\n" : "\n") << "    {\n"
+			<< "      \"depth\": " << d << ",\n";
+		write_level_json(os, s, "      ");
+		os << "    }";
+
+		total.states += s.states;
+		total.candidates += s.candidates;
+		total.pruned += s.pruned;
+		total.cells_pruned += s.cells_pruned;
+		total.obvious += s.obvious;
+		total.solved += s.solved;
+		total.first_best += s.first_best;
+	}
+	// The time spent at the root includes that of all other states.
+	if (!levels.empty())
+		total.seconds = levels[0].seconds;
+	os << "\n  ],\n  \"total\": {\n";
+	write_level_json(os, total, "    ");
+	os << "  }\n}\n";
 }
 
-StrategyTree build_optimal_strategy_tree(
-	const Engine *e, StrategyObjective obj, StrategyConstraints constraints)
+StrategyTree Mastermind::build_optimal_strategy_tree(
+	const Engine *e, StrategyObjective obj, StrategyConstraints constraints,
+	const OptimalSearchOptions &options, OptimalSearchResult *result)
 {
 	CodewordList all = e->generateCodewords();
 
@@ -517,7 +2684,7 @@ StrategyTree build_optimal_strategy_tree(
 	// response-indepedent filter with a response-dependent filter.
 	CompositeEquivalenceFilter filter(
 		CreateConstraintEquivalenceFilter(e),
-		CreateColorEquivalenceFilter(e));
+		CreateResponseEquivalenceFilter(e, constraints));
 
 	// Create a strategy tree.
 	StrategyTree tree(e->rules());
@@ -529,17 +2696,622 @@ StrategyTree build_optimal_strategy_tree(
 	//c.find_last = false;
 
 	// Create a cost lower-bound estimator.
-	LowerBoundEstimator estimator(e, Heuristics::MinimizeLowerBound(e));
-
-	// Filter canonical candidates for the initial guess.
-	CodewordList initial = filter.get_canonical_guesses(e->universe());
+	LowerBoundEstimator estimator(e,
+		Heuristics::MinimizeLowerBound(e, max_breakable_table(e)));
+
+	// Find canonical candidates for the initial guess.
+	CodewordList initial = get_initial_guesses(e, filter);
+
+	// Create the transposition table and the cache of canonical guesses,
+	// and open the persistent store if requested.
+	SearchContext ctx;
+	std::unique_ptr<TranspositionTable> tt;
+	std::unique_ptr<CanonicalGuessCache> guess_cache;
+	std::unique_ptr<SubproblemStore> store;
+	create_caches(e, obj, constraints, options, ctx, tt, guess_cache, store);
+
+	// Collect the statistics of the states at each depth if requested.
+	// A state at depth d is reached by d guesses, so the depth of a state
+	// is less than the maximum depth.
+	OptimalSearchStatistics statistics;
+	if (options.collect_statistics && result)
+	{
+		statistics.levels.resize(constraints.max_depth);
+		ctx.statistics = &statistics;
+	}
 
-	// Recursively find an optimal strategy.
 	StrategyCost threshold(1000000, 100, 0);
-	/* int best = */ fill_strategy_tree(e, all, initial, 
-		filter.first(), filter.second(), estimator,
+
+	// In an anytime search, first build a heuristic strategy, which is
+	// returned if the search does not find a better one within the
+	// budget. Its cost seeds the threshold. The threshold is one step
+	// above this cost, so that a search that completes still finds the
+	// same strategy as an unlimited search.
+	std::unique_ptr<SearchBudget> budget;
+	StrategyTree seed_tree(e->rules());
+	StrategyCost seed_cost;
+	if (options.time_limit > 0 || options.state_limit > 0)
+	{
+		budget.reset(new SearchBudget(options.time_limit, options.state_limit));
+		ctx.budget = budget.get();
+
+		HeuristicStrategy<Heuristics::MinimizeAverage> strat(e,
+			Heuristics::MinimizeAverage(true));
+		CodeBreakerOptions cbo;
+		cbo.optimize_obvious = constraints.use_obvious;
+		cbo.possibility_only = constraints.pos_only;
+		std::unique_ptr<EquivalenceFilter> copy(filter.clone());
+		seed_tree = BuildStrategyTree(e, &strat, copy.get(), cbo);
+
+		StrategyTreeInfo info("seed", seed_tree, seed_tree.root());
+		if (info.max_depth() <= constraints.max_depth)
+		{
+			seed_cost = StrategyCost((unsigned int)info.total_depth(),
+				(unsigned short)info.max_depth(),
+				(unsigned short)info.count_depth(info.max_depth()));
+			threshold.steps = seed_cost.steps + 1;
+		}
+	}
+
+	// Seed the threshold of large subproblems with the cost of a heuristic
+	// strategy if requested.
+	HeuristicStrategy<Heuristics::MinimizeAverage> seed_strategy(e,
+		Heuristics::MinimizeAverage(true));
+	if (options.seed_size > 0)
+	{
+		ctx.seed_strategy = &seed_strategy;
+		ctx.seed_size = options.seed_size;
+	}
+
+	// Save checkpoints of the search if requested, and resume from the
+	// last one. The checkpoint identifies the options that affect the
+	// result of the search or the content of the checkpoint. The budget
+	// is not one of them, so an anytime search can be resumed with or
+	// without a budget.
+	std::unique_ptr<SearchCheckpoint> checkpoint;
+	if (!options.checkpoint_file.empty())
+	{
+		std::ostringstream header;
+		header << search_header(e, obj, constraints) << " tt " << (ctx.tt != NULL);
+		checkpoint.reset(new SearchCheckpoint(options.checkpoint_file,
+			options.checkpoint_interval, header.str(), ctx.tt));
+		if (options.resume)
+			checkpoint->load(e->rules(), ctx.tt);
+		ctx.checkpoint = checkpoint.get();
+	}
+
+	// Recursively find an optimal strategy. In a parallel search, the
+	// root is searched by one thread and the candidates of the top levels
+	// are spawned as tasks that are picked up by the other threads. The
+	// parallel search is only enabled for the MinSteps objective, because
+	// the depth component of the threshold does not carry over exactly to
+	// the subproblems, so the result would depend on timing otherwise.
+	// The checkpoint only records the serial search.
+	StrategyCost best;
+#if OPTIMAL_PARALLEL_SEARCH
+	if (obj == MinSteps && !checkpoint)
+		ctx.parallel_depth = std::min(options.parallel_depth, MAX_PARALLEL_DEPTH);
+#endif
+
+	// In a distributed search, wait for the workers to connect, and then
+	// search the candidates of the root on them. The workers are told to
+	// exit when the search is done. Like the parallel search, this is only
+	// enabled for the MinSteps objective, and neither with a budget nor
+	// with checkpoints, which only apply to this process.
+#if OPTIMAL_DISTRIBUTED_SEARCH
+	std::unique_ptr<WorkerPool> workers;
+	if (!options.listen_address.empty())
+	{
+		workers.reset(new WorkerPool(options.listen_address, options.workers,
+			search_header(e, obj, constraints)));
+		if (obj == MinSteps && !checkpoint && !budget && options.workers > 0)
+		{
+			ctx.workers = workers.get();
+			ctx.parallel_depth = std::max(ctx.parallel_depth, 1);
+		}
+	}
+#else
+	if (!options.listen_address.empty())
+		throw std::runtime_error("distributed search is not supported by this build");
+#endif
+
+#if OPTIMAL_PARALLEL_SEARCH
+	if (ctx.parallel_depth > 0)
+	{
+		#pragma omp parallel
+		#pragma omp single
+		best = fill_strategy_tree(e, all, initial, 
+			filter.first(), filter.second(), estimator, ctx,
+			0, obj, constraints, threshold, tree, tree.root());
+	}
+	else
+#endif
+	best = fill_strategy_tree(e, all, initial, 
+		filter.first(), filter.second(), estimator, ctx,
 		0, obj, constraints, threshold, tree, tree.root());
-	// std::cout << "OPTIMAL: " << best << std::endl;
+
+	// Fall back to the heuristic strategy if no better one is found.
+	if (!best && !!seed_cost)
+	{
+		tree = seed_tree;
+		best = seed_cost;
+	}
+
+	if (result)
+	{
+		result->complete = !(budget && budget->expired());
+		result->upper_bound = best.steps;
+		result->lower_bound = best.steps;
+		if (!result->complete && budget->open_bound() < best.steps)
+			result->lower_bound = budget->open_bound();
+
+		// Drop the depths that no state reached.
+		while (!statistics.levels.empty() && statistics.levels.back().states == 0 &&
+			statistics.levels.back().obvious == 0)
+			statistics.levels.pop_back();
+		result->statistics = statistics;
+	}
+	return tree;
+}
+
+void Mastermind::serve_optimal_search(
+	const Engine *e, StrategyObjective obj, StrategyConstraints constraints,
+	const OptimalSearchOptions &options, const std::string &address)
+{
+#if OPTIMAL_DISTRIBUTED_SEARCH
+	// Set up the same state as the root of build_optimal_strategy_tree().
+	const CodewordList all = e->generateCodewords();
+	CompositeEquivalenceFilter filter(
+		CreateConstraintEquivalenceFilter(e),
+		CreateResponseEquivalenceFilter(e, constraints));
+	LowerBoundEstimator estimator(e,
+		Heuristics::MinimizeLowerBound(e, max_breakable_table(e)));
+
+	SearchContext ctx;
+	std::unique_ptr<TranspositionTable> tt;
+	std::unique_ptr<CanonicalGuessCache> guess_cache;
+	std::unique_ptr<SubproblemStore> store;
+	create_caches(e, obj, constraints, options, ctx, tt, guess_cache, store);
+
+	// The guess of a job is at the root, so the levels below it are
+	// searched in parallel up to the given depth. Since a nonzero depth
+	// also keeps the transposition table from replaying the guesses it
+	// knows, the strategy found does not depend on the jobs searched
+	// before.
+	ctx.parallel_depth = std::min(1 + options.parallel_depth, MAX_PARALLEL_DEPTH);
+
+	MessageChannel channel(address, WORKER_CONNECT_TIMEOUT);
+	if (!channel.send(search_header(e, obj, constraints)))
+		throw std::runtime_error("cannot connect to " + address);
+
+	// Receive the messages in a separate thread, so that the cut-offs sent
+	// by the coordinator apply to the job being searched.
+	SharedBound shared;
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<std::string> jobs;
+	bool closed = false;
+	std::thread receiver([&]()
+	{
+		std::string message;
+		while (channel.receive(message))
+		{
+			std::istringstream is(message);
+			std::string type;
+			is >> type;
+			if (type == "bound")
+			{
+				unsigned int steps;
+				size_t rank;
+				if (is >> steps >> rank)
+					shared.update(steps, rank);
+			}
+			else if (type == "job")
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(message);
+				ready.notify_one();
+			}
+			else
+			{
+				break;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		ready.notify_one();
+	});
+
+	StrategyCostComparer superior(obj);
+	for (;;)
+	{
+		std::string message;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [&]() { return closed || !jobs.empty(); });
+			if (jobs.empty())
+				break;
+			message = jobs.front();
+			jobs.pop_front();
+		}
+
+		std::istringstream is(message);
+		std::string type;
+		size_t rank;
+		Codeword::compact_type packed;
+		StrategyCost score, threshold;
+		int max_depth;
+		if (!((is >> type >> rank >> packed) && read_cost(is, score) &&
+			(is >> max_depth) && read_cost(is, threshold)))
+			break;
+
+		StrategyConstraints c = constraints;
+		c.max_depth = (unsigned char)max_depth;
+
+		SearchContext task_ctx(ctx);
+		task_ctx.bounds[task_ctx.nbounds].shared = &shared;
+		task_ctx.bounds[task_ctx.nbounds].rank = rank;
+		task_ctx.bounds[task_ctx.nbounds].offset = 0;
+		++task_ctx.nbounds;
+		task_ctx.tighten(threshold, obj);
+
+		// Search the guess as search_guesses_parallel() does.
+		CodewordList secrets(all);
+		StrategyTree tree(e->rules());
+		StrategyCost cost;
+		bool found = false;
+		if (superior(score, threshold))
+		{
+			if (ctx.parallel_depth > 1)
+			{
+				#pragma omp parallel
+				#pragma omp single
+				found = search_guess(e, secrets, Codeword::unpack(packed),
+					NULL, score, filter.first(), filter.second(), estimator,
+					task_ctx, 0, obj, c, threshold, NULL, tree, tree.root(), cost);
+			}
+			else
+			{
+				found = search_guess(e, secrets, Codeword::unpack(packed),
+					NULL, score, filter.first(), filter.second(), estimator,
+					task_ctx, 0, obj, c, threshold, NULL, tree, tree.root(), cost);
+			}
+		}
+
+		std::ostringstream os;
+		os << "result " << rank << ' ' << (found? 1 : 0);
+		write_cost(os, found? cost : StrategyCost());
+		os << '\n';
+		if (found)
+			write_tree_nodes(os, tree, tree.root(), 1, 1, tree.size());
+		if (!channel.send(os.str()))
+			break;
+	}
+
+	// The receiver returns once the coordinator closes the connection.
+	receiver.join();
+#else
+	(void)e;
+	(void)obj;
+	(void)constraints;
+	(void)options;
+	throw std::runtime_error("cannot connect to " + address +
+		": distributed search is not supported by this build");
+#endif
+}
+
+/// Search-wide state of the search for a strategy of minimum depth.
+struct DepthSearchContext
+{
+	/// Table of the maximum number of secrets that any strategy reveals
+	/// within a given number of guesses.
+	std::vector<unsigned int> breakable;
+
+	/// Whether to also minimize the number of secrets revealed by the
+	/// last guess allowed. Otherwise the first strategy found is returned.
+	bool min_worst;
+
+	/// Transposition table that caches solved subproblems, or @c NULL if
+	/// not used. The steps of the cost of an entry is the number of
+	/// secrets revealed by the last guess allowed.
+	TranspositionTable *tt;
+
+	/// Cache of the canonical guesses of the equivalence filter states,
+	/// or @c NULL if not used.
+	CanonicalGuessCache *guess_cache;
+
+	/// Returns an upper bound of the number of secrets that any strategy
+	/// reveals within @c k guesses.
+	unsigned int max_breakable(int k) const
+	{
+		if (k <= 0)
+			return 0;
+		if ((size_t)k < breakable.size())
+			return breakable[k];
+		return breakable.back();
+	}
+
+	/// Returns a lower bound of the number of secrets revealed by the
+	/// last of @c k guesses allowed to reveal @c n secrets. The secrets
+	/// that cannot be revealed within <code>k-1</code> guesses take all
+	/// @c k guesses.
+	unsigned int min_worst_count(unsigned int n, int k) const
+	{
+		unsigned int m = max_breakable(k - 1);
+		return (n > m)? n - m : 0;
+	}
+};
+
+/**
+ * Searches for a strategy that reveals each of the given secrets within
+ * @c k guesses. If <code>ctx.min_worst</code> is set, the strategy also
+ * minimizes the number of secrets revealed by the k-th guess; otherwise
+ * the first strategy found is returned.
+ *
+ * A state is pruned if it has more secrets than any strategy reveals
+ * within @c k guesses, and a guess is pruned if one of its cells has
+ * more secrets than any strategy reveals within <code>k-1</code> guesses.
+ * The candidate guesses are tried in order of the lower bound of the
+ * number of secrets revealed by the k-th guess, and then of the size of
+ * their largest cell, so that the first strategy found is usually that
+ * of the min-max heuristic.
+ *
+ * @returns The number of secrets revealed by the k-th guess if a strategy
+ *      is found where this number is less than @c threshold, or -1 if no
+ *      such strategy exists.
+ */
+static int fill_depth_strategy_tree(
+	const Engine *e,
+	CodewordRange secrets,            // remaining secrets; will be partitioned
+	CodewordConstRange candidates,    // canonical guesses
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const DepthSearchContext &ctx,    // search-wide state
+	StrategyConstraints c,            // constraints
+	int k,                            // number of guesses allowed
+	int threshold,                    // prunes strategy if count >= threshold
+	StrategyTree &tree,               // tree to store the strategy found
+	StrategyTree::iterator where      // node of the current state
+	)
+{
+	UPDATE_CALL_COUNTER("DepthRecursion", (unsigned int)secrets.size());
+
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const unsigned int nsecrets = (unsigned int)secrets.size();
+	if (nsecrets == 0 || k <= 0 || threshold <= 0)
+		return -1;
+
+	// Short-cut if there is only one secret.
+	if (nsecrets == 1)
+	{
+		int count = (k == 1)? 1 : 0;
+		if (count >= threshold)
+			return -1;
+		tree.insert_child(where, StrategyNode(secrets[0], perfect));
+		return count;
+	}
+
+	// Fail if the secrets cannot be revealed within k guesses.
+	if (nsecrets > ctx.max_breakable(k))
+		return -1;
+	int lower_bound = (int)ctx.min_worst_count(nsecrets, k);
+	if (lower_bound >= threshold)
+		return -1;
+
+	// Look up the transposition table. A known count either fails the
+	// state or is replayed; a known lower bound tightens the estimate.
+	TranspositionTable::Key key;
+	CodewordList replay;
+	if (ctx.tt)
+	{
+		key = TranspositionTable::make_key(secrets, k);
+		TranspositionTable::Entry entry;
+		if (ctx.tt->probe(key, entry))
+		{
+			if ((int)entry.cost.steps >= threshold)
+				return -1;
+			if (entry.type == TranspositionTable::Exact)
+			{
+				replay.push_back(Codeword::unpack(entry.guess));
+				candidates = replay;
+			}
+			else
+			{
+				lower_bound = std::max(lower_bound, (int)entry.cost.steps);
+			}
+		}
+	}
+
+	// Any strategy that meets the depth limit will do unless the count is
+	// minimized, so use an obvious strategy if one exists.
+	const size_t mark = tree.size();
+	if (!ctx.min_worst && c.use_obvious && replay.empty())
+	{
+		c.max_depth = (unsigned char)std::min(k, 100);
+		StrategyCost cost = fill_obviously_optimal_strategy(
+			e, secrets, MinSteps, c, tree, where);
+		if (!!cost)
+		{
+			StrategyTreeInfo info("obvious", tree, where);
+			return (info.max_depth() == k)? (int)info.count_depth(k) : 0;
+		}
+	}
+
+	// Score each candidate guess by the lower bound of the number of
+	// secrets revealed by the k-th guess, and by the size of its largest
+	// cell. Skip the guesses that leave a cell too large to be revealed
+	// within k-1 guesses, or that do not split the secrets.
+	struct Score
+	{
+		int bound;
+		unsigned int largest;
+		size_t index;
+	};
+	std::vector<Score> scores;
+	const unsigned int capacity = ctx.max_breakable(k - 1);
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		FeedbackFrequencyTable freq = e->compare(candidates[i], secrets);
+		Score score = { 0, 0, i };
+		if (k == 1 && freq[perfect.value()] > 0)
+			score.bound = 1;
+		for (size_t j = 0; j < freq.size(); ++j)
+		{
+			if (Feedback(j) != perfect && freq[j] > 0)
+			{
+				score.bound += (int)ctx.min_worst_count(freq[j], k - 1);
+				score.largest = std::max(score.largest, freq[j]);
+			}
+		}
+		if (score.largest <= capacity && score.largest < nsecrets &&
+			score.bound < threshold)
+			scores.push_back(score);
+	}
+	std::sort(scores.begin(), scores.end(), [](const Score &a, const Score &b)
+	{
+		if (a.bound != b.bound)
+			return a.bound < b.bound;
+		if (a.largest != b.largest)
+			return a.largest < b.largest;
+		return a.index < b.index;
+	});
+
+	// Each candidate guess partitions the secrets starting from the same
+	// order, and its strategy is built in place as in fill_strategy_tree().
+	CodewordList initial_order(secrets.begin(), secrets.end());
+	PartitionSet partitions(e, initial_order);
+	size_t best_end = mark;
+	int best = -1;
+	Codeword best_guess;
+	for (size_t index = 0; index < scores.size(); ++index)
+	{
+		const Score &score = scores[index];
+		if (score.bound >= threshold)
+			break;
+
+		Codeword guess = candidates[score.index];
+		if (!partitions.insert(guess))
+			continue;
+		std::copy(initial_order.begin(), initial_order.end(), secrets.begin());
+		CodewordPartition cells = e->partition(secrets, partitions.feedbacks());
+
+		// Search the larger cells first, which are the most likely to fail.
+		std::array<int,Feedback::MaxOutcomes> responses;
+		size_t nresponses = cells.size();
+		std::iota(responses.begin(), responses.begin() + nresponses, 0);
+		std::sort(responses.begin(), responses.begin() + nresponses,
+			[&cells](int i, int j) -> bool
+		{
+			if (cells[i].size() != cells[j].size())
+				return cells[i].size() > cells[j].size();
+			return i < j;
+		});
+
+		std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
+		pre_filter->add_constraint(guess, Feedback(), e->universe());
+		PreFilteredGuesses pre_filtered;
+
+		int bound = score.bound;
+		for (size_t j = 0; j < nresponses && bound < threshold; ++j)
+		{
+			Feedback feedback = Feedback(responses[j]);
+			const CodewordRange &cell = cells[feedback.value()];
+			if (cell.empty())
+				continue;
+
+			StrategyTree::iterator it = tree.insert_child(where,
+				StrategyNode(guess, feedback));
+			if (feedback == perfect)
+				continue;
+
+			std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
+			new_filter->add_constraint(guess, feedback, cell);
+			CodewordList canonical = get_cell_canonical_guesses(e,
+				ctx.guess_cache, secrets, pre_filter.get(), new_filter.get(),
+				c, pre_filtered);
+
+			// The cell may use up the slack left by the other cells.
+			int cell_bound = (int)ctx.min_worst_count((unsigned int)cell.size(), k - 1);
+			int count = fill_depth_strategy_tree(e, cell, canonical,
+				pre_filter.get(), new_filter.get(), ctx, c, k - 1,
+				threshold - (bound - cell_bound), tree, it);
+			if (count < 0)
+				bound = threshold;
+			else
+				bound += (count - cell_bound);
+		}
+
+		if (bound >= threshold)
+		{
+			tree.rollback(best_end);
+			continue;
+		}
+
+		// Replace the previous best strategy with this one.
+		tree.erase(mark, best_end);
+		best_end = tree.size();
+		best = bound;
+		best_guess = guess;
+		threshold = bound;
+
+		// Stop if any strategy will do, or if the count cannot be lower.
+		if (!ctx.min_worst || best <= lower_bound)
+			break;
+	}
+
+	// Store the result in the transposition table. If no strategy is
+	// found, the threshold is a lower bound of the count. A strategy that
+	// is not minimized, or that replays a known guess, proves nothing.
+	if (ctx.tt && replay.empty())
+	{
+		if (best < 0)
+			ctx.tt->store(key, TranspositionTable::LowerBound,
+				StrategyCost(threshold, (unsigned short)k, 0), Codeword(), nsecrets);
+		else if (ctx.min_worst)
+			ctx.tt->store(key, TranspositionTable::Exact,
+				StrategyCost(best, (unsigned short)k, 0), best_guess, nsecrets);
+	}
+	return best;
+}
+
+StrategyTree Mastermind::build_depth_optimal_strategy_tree(
+	const Engine *e, bool min_worst, StrategyConstraints constraints,
+	const OptimalSearchOptions &options)
+{
+	CompositeEquivalenceFilter filter(
+		CreateConstraintEquivalenceFilter(e),
+		CreateResponseEquivalenceFilter(e, constraints));
+	CodewordList initial = get_initial_guesses(e, filter);
+
+	DepthSearchContext ctx;
+	ctx.breakable = max_breakable_table(e);
+	ctx.min_worst = min_worst;
+	ctx.tt = NULL;
+	ctx.guess_cache = NULL;
+	// As in the MinSteps search, no result is cached if the guesses are
+	// restricted to the secrets, since it then depends on the parent.
+	std::unique_ptr<TranspositionTable> tt;
+	std::unique_ptr<CanonicalGuessCache> guess_cache;
+	create_caches(options, !constraints.pos_only, ctx, tt, guess_cache);
+
+	// Deepen the limit from the least depth allowed by the table of the
+	// maximum number of secrets revealed, until a strategy is found. Each
+	// limit that fails proves that no strategy reveals all secrets within
+	// that many guesses, so the first strategy found has minimum depth.
+	CodewordList all = e->generateCodewords();
+	const unsigned int total = (unsigned int)all.size();
+	int depth = 1;
+	while (ctx.max_breakable(depth) < total)
+		++depth;
+
+	StrategyTree tree(e->rules());
+	for (; depth <= (int)constraints.max_depth; ++depth)
+	{
+		if (fill_depth_strategy_tree(e, all, initial, filter.first(),
+			filter.second(), ctx, constraints, depth, (int)total + 1, tree,
+			tree.root()) >= 0)
+			break;
+	}
 	return tree;
 }
 
@@ -4,9 +4,12 @@
 #include <cassert>
 #include <vector>
 #include <numeric>
+#include <string>
+#include <iostream>
 
 #include "Engine.hpp"
 #include "Strategy.hpp"
+#include "StrategyTree.hpp"
 #include "util/call_counter.hpp"
 #include "util/intrinsic.hpp"
 
@@ -65,26 +68,80 @@ public:
 private:
 
 	//Engine &e;
+	int _max_b;
+	std::vector<unsigned int> _breakable;
 	std::vector<score_t> _cache;
 
-public:
+	// Returns an estimate of minimum total number of steps required to
+	// reveal @c n secrets given a branching factor of @c b, where no more
+	// than <code>_breakable[d]</code> secrets are revealed within @c d
+	// guesses. If @c possible is @c false, the initial guess is not one
+	// of the secrets.
+	score_t bounded_estimate(int n, int b, bool possible) const
+	{
+		score_t cost;
+		unsigned int revealed = 0, count = 1;
+		for (size_t d = 1; revealed < (unsigned int)n; ++d)
+		{
+			cost.steps += (n - revealed);
+			cost.depth++;
+			if (d > 1 || possible)
+				revealed += count;
+			if (d < _breakable.size() && revealed > _breakable[d])
+				revealed = _breakable[d];
+			if (count < (unsigned int)n)
+				count *= b;
+		}
+		return cost;
+	}
 
-	/// Constructs the heuristic.
-	MinimizeLowerBound(const Engine *engine)
-		: /* e(engine), */ _cache(engine->rules().size()+1)
+	// Builds a cache of the estimates for the maximum branching factor.
+	void build_cache(const Engine *engine)
 	{
-		// Build a cache of simple estimates.
 		int p = engine->rules().pegs();
-		int b = p*(p+3)/2-1;
+		_max_b = p*(p+3)/2-1;
+		_cache.resize(engine->rules().size()+1);
 		for (size_t n = 0; n < _cache.size(); ++n)
 		{
-			_cache[n] = simple_estimate((int)n, b);
+			_cache[n] = bounded_estimate((int)n, _max_b, true);
 		}
 	}
 
+public:
+
+	/// Constructs the heuristic.
+	MinimizeLowerBound(const Engine *engine)
+	{
+		build_cache(engine);
+	}
+
+	/**
+	 * Constructs the heuristic with a table of the maximum number of
+	 * secrets that any strategy reveals within a given number of guesses.
+	 *
+	 * @param engine The algorithm engine.
+	 * @param max_breakable Table whose <code>d</code>-th element is an
+	 *      upper bound of the number of secrets that any strategy reveals
+	 *      within @c d guesses, starting from any set of secrets. This
+	 *      bounds the number of secrets revealed in the first few steps
+	 *      more tightly than the branching factor does, which improves
+	 *      both the steps and the depth of the estimate.
+	 */
+	MinimizeLowerBound(
+		const Engine *engine,
+		const std::vector<unsigned int> &max_breakable)
+		: _breakable(max_breakable)
+	{
+		build_cache(engine);
+	}
+
 	/// Returns the name of the heuristic.
 	std::string name() const { return "Min-LB"; }
 
+	/// Returns the maximum branching factor for the game, i.e. the number
+	/// of distinct non-perfect feedbacks.
+	int max_branching() const { return _max_b; }
+
 	/// Returns a simple estimate of minimum total number of steps
 	/// required to reveal @c n secrets, including the initial guess,
 	/// assuming the maximum branching factor for the game.
@@ -94,6 +151,28 @@ public:
 		return _cache[n];
 	}
 
+	/// Returns a simple estimate of minimum total number of steps
+	/// required to reveal @c n secrets, including the initial guess,
+	/// if no guess produces more than @c b distinct non-perfect
+	/// feedbacks against the secrets. Only the estimates for the
+	/// maximum branching factor are cached.
+	score_t estimate(int n, int b) const
+	{
+		assert(b >= 1 && b <= _max_b);
+		return (b == _max_b)? simple_estimate(n) : bounded_estimate(n, b, true);
+	}
+
+	/// Returns a simple estimate of minimum total number of steps
+	/// required to reveal @c n secrets, including the initial guess,
+	/// if the initial guess is not one of the secrets and no guess
+	/// produces more than @c b distinct non-perfect feedbacks against
+	/// the secrets.
+	score_t estimate_impossible(int n, int b) const
+	{
+		assert(b >= 1 && b <= _max_b);
+		return bounded_estimate(n, b, false);
+	}
+
 	/// Computes the heuristic score. The score consist of two parts:
 	/// - The total number of steps needed to reveal all secrets, excluding
 	///   the initial guess
@@ -215,6 +294,224 @@ public:
 
 } // namespace Mastermind::Heuristics
 
+/// Stores options that control the search for an optimal strategy. These
+/// options affect the running time of the search but not its result.
+/// @ingroup Optimal
+struct OptimalSearchOptions
+{
+	/// Size (in megabytes) of the transposition table that caches solved
+	/// subproblems. Zero disables the table. The table is only used for
+	/// the @c MinSteps objective, and not if the guesses are restricted to
+	/// the remaining secrets.
+	size_t tt_size;
+
+	/// Size (in megabytes) of the cache of the canonical guesses of each
+	/// state of the equivalence filters, which saves filtering all
+	/// codewords again in a state whose filters are in the same state as
+	/// those of a state searched before. Zero disables the cache.
+	size_t guess_cache_size;
+
+	/// Number of levels at the top of the search tree whose candidate
+	/// guesses are searched in parallel. Zero disables parallel search.
+	/// The strategy found is the same regardless of this value and of
+	/// the number of threads. Only used for the @c MinSteps objective.
+	int parallel_depth;
+
+	/// Time budget of the search in seconds, or zero if unlimited. If
+	/// the budget runs out, the search stops and returns the best strategy
+	/// found so far. A heuristic strategy is built first, so that some
+	/// strategy is always available.
+	double time_limit;
+
+	/// Maximum number of states searched, or zero if unlimited. Like the
+	/// time budget, the search stops once it has entered that many states.
+	/// Unlike it, the point where a serial search stops does not depend on
+	/// the speed of the machine.
+	unsigned long long state_limit;
+
+	/// Minimum number of remaining secrets of a subproblem for which the
+	/// cost of a heuristic strategy is computed first to seed the threshold
+	/// of the search, or zero if not used. A tight threshold early in the
+	/// search prunes most candidates before any recursion. The strategy
+	/// found is the same regardless of this value. Only used for the
+	/// @c MinSteps objective.
+	size_t seed_size;
+
+	/// Path of the file to which the state of the search is saved
+	/// periodically, or empty if no checkpoint is saved. The search can
+	/// later be resumed from the file, and then finds the same strategy
+	/// as an uninterrupted search. Saving checkpoints disables parallel
+	/// search.
+	std::string checkpoint_file;
+
+	/// Minimum number of seconds between two checkpoints.
+	double checkpoint_interval;
+
+	/// Whether to resume the search from the checkpoint saved in
+	/// @c checkpoint_file. The objective, rules, constraints and the use
+	/// of a transposition table must be the same as those of the search
+	/// that saved the checkpoint.
+	bool resume;
+
+	/// Path of a file that stores the subproblems solved by the search,
+	/// or empty if not used. The file is created if it does not exist.
+	/// The subproblems solved by previous searches on the same rules are
+	/// read from the file, and those solved by this search are appended
+	/// to it. Multiple searches may use the same file at the same time.
+	/// Only used for the @c MinSteps objective, and not if the guesses are
+	/// restricted to the remaining secrets.
+	std::string store_file;
+
+	/// Address on which the search waits for @c workers worker processes
+	/// to connect, or empty if the search runs in this process only. The
+	/// address is either <code>unix:path</code> or <code>host:port</code>.
+	/// The candidate guesses of the root are then searched by the workers,
+	/// each of which runs <code>serve_optimal_search()</code> with the same
+	/// rules, objective and constraints. The strategy found is the same as
+	/// that of a search in a single process. Only used for the @c MinSteps
+	/// objective, and neither with a time or state budget nor with
+	/// checkpoints.
+	/// Each worker must connect within a timeout, 60 seconds by default.
+	std::string listen_address;
+
+	/// Number of worker processes of a distributed search.
+	size_t workers;
+
+	/// Whether to collect the statistics of the states searched at each
+	/// depth, which are returned in <code>OptimalSearchResult</code>.
+	/// The states searched by the workers of a distributed search are
+	/// not included.
+	bool collect_statistics;
+
+	/// Creates a default set of options.
+	OptimalSearchOptions() : tt_size(0), guess_cache_size(64),
+		parallel_depth(0), time_limit(0), state_limit(0),
+		seed_size(0), checkpoint_interval(600), resume(false), workers(0),
+		collect_statistics(false) { }
+};
+
+/// Statistics of the states searched at one depth of an optimal strategy
+/// search. A state is a set of remaining secrets.
+/// @ingroup Optimal
+struct OptimalSearchLevelStatistics
+{
+	/// Number of states entered.
+	unsigned long long states;
+
+	/// Number of candidate guesses whose partition is computed.
+	unsigned long long candidates;
+
+	/// Number of candidate guesses whose partition is computed and which
+	/// are then pruned by a lower bound of their cost before any of their
+	/// cells is searched. The candidates skipped without computing their
+	/// partition, once the cut-off falls below their estimated cost, are
+	/// not counted.
+	unsigned long long pruned;
+
+	/// Number of candidate guesses abandoned after some of their cells
+	/// are searched.
+	unsigned long long cells_pruned;
+
+	/// Number of states solved by an obvious guess without searching.
+	unsigned long long obvious;
+
+	/// Number of states with more than one candidate guess in which a
+	/// strategy is found.
+	unsigned long long solved;
+
+	/// Number of the solved states in which the first candidate guess
+	/// searched turns out to be the best.
+	unsigned long long first_best;
+
+	/// Number of seconds spent in the states, including their subproblems.
+	double seconds;
+
+	/// Creates empty statistics.
+	OptimalSearchLevelStatistics() : states(0), candidates(0), pruned(0),
+		cells_pruned(0), obvious(0), solved(0), first_best(0), seconds(0) { }
+};
+
+/// Statistics of an optimal strategy search, by depth of the states.
+/// @ingroup Optimal
+struct OptimalSearchStatistics
+{
+	/// Statistics of the states at each depth, starting from the root.
+	std::vector<OptimalSearchLevelStatistics> levels;
+
+	/// Writes the statistics to a stream as a JSON object.
+	void write_json(std::ostream &os) const;
+};
+
+/// Reports the outcome of an optimal strategy search.
+/// @ingroup Optimal
+struct OptimalSearchResult
+{
+	/// Whether the search completed, i.e. the strategy returned is
+	/// proven optimal. This is @c false if the time or state budget ran
+	/// out.
+	bool complete;
+
+	/// Total number of steps of the strategy returned.
+	unsigned int upper_bound;
+
+	/// Proven lower bound of the total number of steps of an optimal
+	/// strategy. This is equal to @c upper_bound if the search completed.
+	unsigned int lower_bound;
+
+	/// Statistics of the search, if requested by the options.
+	OptimalSearchStatistics statistics;
+
+	/// Creates an empty result.
+	OptimalSearchResult() : complete(false), upper_bound(0), lower_bound(0) { }
+};
+
+/// Builds an optimal strategy tree for the given objective and constraints.
+/// If @c result is not @c NULL, it receives the outcome of the search.
+/// Throws <code>std::runtime_error</code> if the search is to be resumed
+/// from a checkpoint that cannot be read or does not match the search, or
+/// if the store file cannot be opened or was created for other rules, or
+/// if the workers of a distributed search cannot be reached.
+/// @ingroup Optimal
+StrategyTree build_optimal_strategy_tree(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options = OptimalSearchOptions(),
+	OptimalSearchResult *result = NULL);
+
+/// Builds a strategy that minimizes the maximum number of guesses needed
+/// to reveal a secret, within <code>constraints.max_depth</code> guesses.
+/// The depth limit is deepened from the least depth allowed by the number
+/// of secrets any strategy reveals within a given number of guesses, and
+/// each limit is a feasibility search, so the first strategy found has
+/// minimum depth. If @c min_worst is @c true, the strategy also minimizes
+/// the number of secrets revealed by the last guess; otherwise it is the
+/// first strategy found at that depth. The total number of steps is not
+/// minimized. Of the options, only the transposition table is used.
+/// Returns an empty tree if no strategy meets the constraints.
+/// @ingroup Optimal
+StrategyTree build_depth_optimal_strategy_tree(
+	const Engine *e,
+	bool min_worst,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options = OptimalSearchOptions());
+
+/// Runs a worker of a distributed optimal strategy search. The worker
+/// connects to the coordinator at the given address, which is a process
+/// that calls <code>build_optimal_strategy_tree()</code> with the same
+/// rules, objective and constraints, and searches the candidate guesses
+/// it receives until the coordinator closes the connection. The options
+/// of the search in this process, such as the transposition table and
+/// the parallel depth, apply to each guess. Throws
+/// <code>std::runtime_error</code> if the worker cannot connect.
+/// @ingroup Optimal
+void serve_optimal_search(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options,
+	const std::string &address);
+
 /// Real-time optimal strategy. To be practical, the search space
 /// must be small. For example, it works with Mastermind rules (p4c10r),
 /// but probably not larger.
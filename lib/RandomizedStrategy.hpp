@@ -0,0 +1,82 @@
+#ifndef MASTERMIND_RANDOMIZED_STRATEGY_HPP
+#define MASTERMIND_RANDOMIZED_STRATEGY_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include "Strategy.hpp"
+#include "util/xorshift.hpp"
+
+namespace Mastermind {
+
+/**
+ * Strategy that makes a random but "good" guess. It asks an underlying
+ * strategy to rank the candidate guesses, and picks one of the @c k best
+ * guesses at random with equal probability.
+ *
+ * The random number generator is seeded from the user-supplied seed and
+ * the set of remaining possibilities. Therefore, for a given seed, the
+ * guess depends only on the state of the game. This makes the strategy
+ * thread-safe and a strategy tree built from it reproducible; use a
+ * different seed to obtain a different play.
+ *
+ * @ingroup Randomized
+ */
+class RandomizedStrategy : public Strategy
+{
+	std::unique_ptr<const Strategy> _strat;
+	size_t _k;
+	uint64_t _seed;
+
+	// Computes a hash value of the remaining possibilities (FNV-1a).
+	static uint64_t hash(CodewordConstRange possibilities)
+	{
+		uint64_t h = 14695981039346656037ULL;
+		for (CodewordConstIterator it = possibilities.begin();
+			it != possibilities.end(); ++it)
+		{
+			h ^= it->pack();
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+public:
+
+	/// Constructs a randomized strategy.
+	/// @param strat Underlying strategy used to rank the candidates.
+	///      It must be allocated with @c new, and is deleted with this
+	///      object.
+	/// @param k     Number of best guesses to choose from.
+	/// @param seed  Seed of the random number generator.
+	RandomizedStrategy(const Strategy *strat, size_t k, uint64_t seed)
+		: _strat(strat), _k(k), _seed(seed)
+	{
+		assert(_strat);
+		assert(_k > 0);
+	}
+
+	/// Returns the name of the strategy.
+	virtual std::string name() const
+	{
+		return "random-" + _strat->name();
+	}
+
+	/// Makes a guess chosen at random from the @c k best guesses
+	/// reported by the underlying strategy.
+	virtual Codeword make_guess(
+		CodewordConstRange possibilities,
+		CodewordConstRange candidates) const
+	{
+		RankedGuessList ranks = _strat->rank_guesses(possibilities, candidates, _k);
+		if (ranks.empty())
+			return Codeword();
+
+		util::xorshift64star rng(_seed ^ hash(possibilities));
+		return ranks[(size_t)rng.uniform(ranks.size())].guess;
+	}
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_RANDOMIZED_STRATEGY_HPP
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include "Engine.hpp"
 
 namespace Mastermind {
@@ -245,6 +246,35 @@ inline bool superior(const StrategyCost &a, const StrategyCost &b, StrategyObjec
 }
 #endif
 
+/**
+ * Represents a candidate guess together with its score, as returned by
+ * <code>Strategy::rank_guesses()</code>. A lower score indicates a better
+ * guess. Only the relative order of the scores returned from the same call
+ * is meaningful.
+ *
+ * @ingroup strat
+ */
+struct RankedGuess
+{
+	/// The candidate guess.
+	Codeword guess;
+
+	/// Score of the guess, converted to a scalar value.
+	double score;
+
+	/// Creates an empty ranked guess.
+	RankedGuess() : guess(), score(0.0) { }
+
+	/// Creates a ranked guess with the given score.
+	RankedGuess(const Codeword &_guess, double _score)
+		: guess(_guess), score(_score) { }
+};
+
+/// List of ranked guesses, best guess first.
+/// @ingroup strat
+typedef std::vector<RankedGuess,util::aligned_allocator<RankedGuess,16>>
+	RankedGuessList;
+
 /**
  * Interface for a Mastermind strategy.
  *
@@ -263,6 +293,9 @@ inline bool superior(const StrategyCost &a, const StrategyCost &b, StrategyObjec
  */
 struct Strategy
 {
+	/// Destroys the strategy.
+	virtual ~Strategy() { }
+
 	/// Returns the name of the strategy.
 	virtual std::string name() const = 0;
 
@@ -281,6 +314,36 @@ struct Strategy
 	virtual Codeword make_guess(
 		CodewordConstRange possibilities,
 		CodewordConstRange candidates) const = 0;
+
+	/**
+	 * Ranks the candidate guesses and returns the best ones.
+	 *
+	 * @param possibilities List of remaining possibilities.
+	 * @param candidates    List of candidate guesses to rank.
+	 * @param k             Maximum number of guesses to return.
+	 * @returns Up to @c k guesses in increasing order of score, i.e. the
+	 *      best guess first. The first guess returned is the guess that
+	 *      <code>make_guess()</code> would make.
+	 *
+	 * The default implementation returns the single guess made by
+	 * <code>make_guess()</code> with a score of zero. Strategies that
+	 * score each candidate should override this method to return the
+	 * @c k best candidates from a single scan.
+	 */
+	virtual RankedGuessList rank_guesses(
+		CodewordConstRange possibilities,
+		CodewordConstRange candidates,
+		size_t k) const
+	{
+		RankedGuessList ranks;
+		if (k > 0)
+		{
+			Codeword guess = make_guess(possibilities, candidates);
+			if (!guess.IsEmpty())
+				ranks.push_back(RankedGuess(guess, 0.0));
+		}
+		return ranks;
+	}
 };
 
 } // namespace Mastermind
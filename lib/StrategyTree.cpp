@@ -24,15 +24,17 @@ StrategyTreeInfo::StrategyTreeInfo(
 	: _tree(&tree), _root(root), _total_secrets(0), _total_depth(0),
 	_depth_freq(1), 	_children(Feedback::size(tree.rules())), _name(name)
 {
+	auto children = tree.children(root);
+	for (auto it = children.begin(); it != children.end(); ++it)
+	{
+		_children[it->response().value()] = it;
+	}
+
 	Feedback perfect = Feedback::perfectValue(tree.rules());
 	auto root_depth = root.depth();
 	auto nodes = tree.traverse(root);
 	for (auto it = nodes.begin(); it != nodes.end(); ++it)
 	{
-		if (it.depth() == root_depth + 1)
-		{
-			_children[it->response().value()] = it;
-		}
 		if (it->response() == perfect)
 		{
 			unsigned int d = it.depth() - root_depth;
@@ -20,8 +20,9 @@ class StrategyNode
 
 public:
 
-	/// Constructs a node corresponding to the root state.
-	StrategyNode() { }
+	/// Constructs a node corresponding to the root state, which has an
+	/// empty guess.
+	StrategyNode() : _guess(Codeword().pack()), _response(0) { }
 
 	/// Constructs a node with the given guess and response.
 	StrategyNode(const Codeword &guess, const Feedback &response)
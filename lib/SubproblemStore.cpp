@@ -0,0 +1,363 @@
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "SubproblemStore.hpp"
+#include "util/call_counter.hpp"
+
+// Number of records buffered before they are appended to the file.
+#ifndef SUBPROBLEM_STORE_BATCH_SIZE
+#define SUBPROBLEM_STORE_BATCH_SIZE 256
+#endif
+
+namespace Mastermind {
+
+namespace {
+
+/// Header at the beginning of a store file.
+struct FileHeader
+{
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t record_size;
+	uint8_t pegs, colors, repeatable, reserved;
+	uint32_t reserved2;
+};
+
+const char Magic[8] = { 'm', 'm', 's', 't', 'o', 'r', 'e', '1' };
+
+FileHeader make_header(const Rules &rules)
+{
+	FileHeader h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, Magic, sizeof(Magic));
+	h.byte_order = 0x01020304;
+	h.record_size = (uint32_t)sizeof(SubproblemStore::Record);
+	h.pegs = (uint8_t)rules.pegs();
+	h.colors = (uint8_t)rules.colors();
+	h.repeatable = rules.repeatable()? 1 : 0;
+	return h;
+}
+
+/// Computes the checksum of a record, which covers all fields before it.
+uint32_t checksum(const SubproblemStore::Record &r)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(&r);
+	uint32_t h = 2166136261U;
+	for (size_t i = 0; i < offsetof(SubproblemStore::Record, checksum); ++i)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+/// Tests whether a record is a better result than another one for the
+/// same subproblem. An exact cost is better than a lower bound, and a
+/// tighter lower bound is better than a looser one. Of two exact costs,
+/// the first one stored is kept.
+bool better(const SubproblemStore::Record &a, const SubproblemStore::Record &b)
+{
+	if (b.type == TranspositionTable::Exact)
+		return false;
+	return a.type == TranspositionTable::Exact || a.steps > b.steps;
+}
+
+#ifdef _WIN32
+int open_append(const std::string &path, bool create)
+{
+	int flags = _O_WRONLY | _O_APPEND | _O_BINARY;
+	if (create)
+		flags |= _O_CREAT | _O_EXCL;
+	return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+}
+
+bool write_all(int fd, const void *data, size_t size)
+{
+	return _write(fd, data, (unsigned int)size) == (int)size;
+}
+
+void close_file(int fd)
+{
+	_close(fd);
+}
+#else
+int open_append(const std::string &path, bool create)
+{
+	int flags = O_WRONLY | O_APPEND;
+	if (create)
+		flags |= O_CREAT | O_EXCL;
+	return open(path.c_str(), flags, 0666);
+}
+
+bool write_all(int fd, const void *data, size_t size)
+{
+	return write(fd, data, size) == (ssize_t)size;
+}
+
+void close_file(int fd)
+{
+	close(fd);
+}
+#endif
+
+} // anonymous namespace
+
+SubproblemStore::SubproblemStore(
+	const std::string &path, const Rules &rules, uint8_t tag)
+	: _path(path), _tag(tag), _view(NULL), _view_size(0), _view_handle(NULL),
+	_fd(-1), _loaded(0)
+{
+	// Create the file with its header if it does not exist. The header is
+	// written by a single call, so that other processes that open the file
+	// see either an empty file or the complete header.
+	const FileHeader header = make_header(rules);
+	_fd = open_append(path, true);
+	if (_fd >= 0)
+	{
+		if (!write_all(_fd, &header, sizeof(header)))
+		{
+			close_file(_fd);
+			throw std::runtime_error("cannot write store file " + path);
+		}
+	}
+	else
+	{
+		_fd = open_append(path, false);
+		if (_fd < 0)
+			throw std::runtime_error("cannot open store file " + path);
+	}
+
+	map_file();
+	if (_view_size > 0)
+	{
+		FileHeader h;
+		if (_view_size < sizeof(h))
+		{
+			unmap_file();
+			close_file(_fd);
+			throw std::runtime_error(path + " is not a store file");
+		}
+		std::memcpy(&h, _view, sizeof(h));
+		if (std::memcmp(h.magic, Magic, sizeof(Magic)) != 0 ||
+			h.byte_order != header.byte_order ||
+			h.record_size != header.record_size)
+		{
+			unmap_file();
+			close_file(_fd);
+			throw std::runtime_error(path + " is not a store file");
+		}
+		if (h.pegs != header.pegs || h.colors != header.colors ||
+			h.repeatable != header.repeatable)
+		{
+			unmap_file();
+			close_file(_fd);
+			throw std::runtime_error("store file " + path +
+				" was created for different rules");
+		}
+	}
+
+	// Index the complete records. Records are aligned in the file because
+	// the header size is a multiple of the alignment of a record.
+	static_assert(sizeof(FileHeader) % sizeof(uint64_t) == 0,
+		"records must be aligned");
+	size_t n = (_view_size > sizeof(FileHeader))?
+		(_view_size - sizeof(FileHeader)) / sizeof(Record) : 0;
+	const Record *records = reinterpret_cast<const Record *>(
+		_view + sizeof(FileHeader));
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Record &r = records[i];
+		if (r.checksum == checksum(r) && r.tag == _tag &&
+			(r.type == TranspositionTable::Exact ||
+			 r.type == TranspositionTable::LowerBound))
+		{
+			add(&r);
+			++_loaded;
+		}
+	}
+}
+
+SubproblemStore::~SubproblemStore()
+{
+	write_pending();
+	unmap_file();
+	if (_fd >= 0)
+		close_file(_fd);
+}
+
+#ifdef _WIN32
+void SubproblemStore::map_file()
+{
+	HANDLE file = CreateFileA(_path.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (view != NULL)
+			{
+				_view = static_cast<const char *>(view);
+				_view_size = (size_t)size.QuadPart;
+				_view_handle = mapping;
+			}
+			else
+			{
+				CloseHandle(mapping);
+			}
+		}
+	}
+	CloseHandle(file);
+}
+
+void SubproblemStore::unmap_file()
+{
+	if (_view)
+	{
+		UnmapViewOfFile(_view);
+		CloseHandle((HANDLE)_view_handle);
+	}
+	_view = NULL;
+	_view_size = 0;
+	_view_handle = NULL;
+}
+#else
+void SubproblemStore::map_file()
+{
+	int fd = open(_path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (view != MAP_FAILED)
+		{
+			_view = static_cast<const char *>(view);
+			_view_size = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+}
+
+void SubproblemStore::unmap_file()
+{
+	if (_view)
+		munmap(const_cast<char *>(_view), _view_size);
+	_view = NULL;
+	_view_size = 0;
+}
+#endif
+
+void SubproblemStore::add(const Record *r)
+{
+	TranspositionTable::Key key;
+	key.h1 = r->h1;
+	key.h2 = r->h2;
+	std::pair<Index::iterator, bool> ret = _index.insert(std::make_pair(key, r));
+	if (!ret.second && better(*r, *ret.first->second))
+		ret.first->second = r;
+}
+
+bool SubproblemStore::probe(
+	const TranspositionTable::Key &key,
+	TranspositionTable::Entry &entry) const
+{
+	bool found = false;
+	#pragma omp critical (SubproblemStore_Access)
+	{
+		Index::const_iterator it = _index.find(key);
+		if (it != _index.end())
+		{
+			const Record &r = *it->second;
+			entry.key = key;
+			entry.cost = StrategyCost(r.steps, r.depth, r.worst);
+			entry.guess = r.guess;
+			entry.size = r.size;
+			entry.type = r.type;
+			found = true;
+		}
+	}
+	if (found)
+		UPDATE_CALL_COUNTER("SubproblemStore_Hit", entry.size);
+	else
+		UPDATE_CALL_COUNTER("SubproblemStore_Miss", 0);
+	return found;
+}
+
+void SubproblemStore::store(
+	const TranspositionTable::Key &key,
+	TranspositionTable::BoundType type,
+	const StrategyCost &cost,
+	const Codeword &guess,
+	size_t size)
+{
+	assert(type != TranspositionTable::Empty);
+
+	Record r;
+	std::memset(&r, 0, sizeof(r));
+	r.h1 = key.h1;
+	r.h2 = key.h2;
+	r.steps = cost.steps;
+	r.depth = cost.depth;
+	r.worst = cost.worst;
+	r.guess = (type == TranspositionTable::Exact)? guess.pack() : 0;
+	r.size = (uint32_t)size;
+	r.type = (uint8_t)type;
+	r.tag = _tag;
+	r.checksum = checksum(r);
+
+	#pragma omp critical (SubproblemStore_Access)
+	{
+		Index::const_iterator it = _index.find(key);
+		if (it == _index.end() || better(r, *it->second))
+		{
+			_added.push_back(r);
+			add(&_added.back());
+			_pending.push_back(r);
+			if (_pending.size() >= SUBPROBLEM_STORE_BATCH_SIZE)
+				write_pending();
+		}
+	}
+}
+
+void SubproblemStore::flush()
+{
+	#pragma omp critical (SubproblemStore_Access)
+	write_pending();
+}
+
+void SubproblemStore::write_pending()
+{
+	// The records are appended by a single call, so that they are not
+	// interleaved with those appended by other processes.
+	if (!_pending.empty() && _fd >= 0)
+	{
+		if (!write_all(_fd, _pending.data(), _pending.size() * sizeof(Record)))
+		{
+			std::cerr << "Warning: cannot write store file " << _path << std::endl;
+			close_file(_fd);
+			_fd = -1;
+		}
+	}
+	_pending.clear();
+}
+
+} // namespace Mastermind
@@ -0,0 +1,142 @@
+#ifndef MASTERMIND_SUBPROBLEM_STORE_HPP
+#define MASTERMIND_SUBPROBLEM_STORE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Rules.hpp"
+#include "Strategy.hpp"
+#include "TranspositionTable.hpp"
+
+namespace Mastermind {
+
+/**
+ * Persistent store of the subproblems solved by the optimal strategy
+ * search, shared by successive searches on the same rules.
+ *
+ * The store is a file of fixed-size binary records that is only ever
+ * appended to. Each record holds the key of a subproblem, as computed by
+ * <code>TranspositionTable::make_key()</code>, a tag that identifies the
+ * objective and constraints of the search that solved it, and either the
+ * exact cost of the optimal strategy together with its first guess, or a
+ * proven lower bound of the cost. Since the key includes the remaining
+ * depth, a search with a different maximum depth still reuses the
+ * subproblems it has in common with the searches before it.
+ *
+ * When the store is opened, the records present in the file are mapped
+ * into memory and indexed; records with a different tag are ignored.
+ * New results are buffered and appended in whole records, so multiple
+ * processes may read and append to the same file at the same time. A
+ * record that is incomplete or fails its checksum, such as the tail of
+ * a file still being written, is skipped.
+ *
+ * The store may be accessed concurrently by multiple threads.
+ *
+ * @ingroup Optimal
+ */
+class SubproblemStore
+{
+public:
+
+	/// Layout of a record in the file.
+	struct Record
+	{
+		uint64_t h1, h2;
+		uint32_t steps;
+		uint16_t depth;
+		uint16_t worst;
+		uint32_t guess;
+		uint32_t size;
+		uint8_t type;
+		uint8_t tag;
+		uint16_t reserved;
+		uint32_t checksum;
+	};
+
+private:
+
+	struct KeyHash
+	{
+		size_t operator () (const TranspositionTable::Key &key) const
+		{
+			return (size_t)key.h1;
+		}
+	};
+
+	struct KeyEqual
+	{
+		bool operator () (const TranspositionTable::Key &a,
+			const TranspositionTable::Key &b) const
+		{
+			return a.h1 == b.h1 && a.h2 == b.h2;
+		}
+	};
+
+	typedef std::unordered_map<TranspositionTable::Key, const Record *,
+		KeyHash, KeyEqual> Index;
+
+	std::string _path;
+	uint8_t _tag;
+
+	// Records mapped from the file when it is opened.
+	const char *_view;
+	size_t _view_size;
+	void *_view_handle;
+
+	// Records added since the store is opened, and those of them that
+	// are not yet written to the file.
+	std::deque<Record> _added;
+	std::vector<Record> _pending;
+	int _fd;
+
+	Index _index;
+	size_t _loaded;
+
+	void map_file();
+	void unmap_file();
+	void write_pending();
+	void add(const Record *r);
+
+	SubproblemStore(const SubproblemStore &);
+	SubproblemStore& operator = (const SubproblemStore &);
+
+public:
+
+	/// Opens the store in the given file for searches on the given rules,
+	/// creating the file if it does not exist. Only the records with the
+	/// given tag are used. Throws <code>std::runtime_error</code> if the
+	/// file cannot be opened, or is not a store for the same rules.
+	SubproblemStore(const std::string &path, const Rules &rules, uint8_t tag);
+
+	/// Appends the results not yet written to the file, and closes it.
+	~SubproblemStore();
+
+	/// Returns the number of usable records in the file when it was
+	/// opened.
+	size_t loaded() const { return _loaded; }
+
+	/// Looks up a subproblem. Returns @c true and stores the result in
+	/// @c entry if the subproblem is found.
+	bool probe(const TranspositionTable::Key &key,
+		TranspositionTable::Entry &entry) const;
+
+	/// Stores the result of a subproblem, unless the store already has
+	/// the exact cost or a lower bound at least as tight.
+	void store(
+		const TranspositionTable::Key &key,
+		TranspositionTable::BoundType type,
+		const StrategyCost &cost,
+		const Codeword &guess,
+		size_t size);
+
+	/// Appends the results not yet written to the file.
+	void flush();
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_SUBPROBLEM_STORE_HPP
@@ -0,0 +1,320 @@
+#include <cassert>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+
+#include "Engine.hpp"
+#include "Permutation.hpp"
+#include "Equivalence.hpp"
+
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+// Maximum number of symmetries of the remaining secrets to keep. Each
+// candidate guess is checked against every symmetry kept.
+static const size_t MaxSymmetries = 64;
+
+// Maximum number of peg and color permutations to check against the
+// remaining secrets when looking for their symmetries.
+static const size_t MaxSymmetryTrials = 1024;
+
+/**
+ * Represents an equivalence filter by the symmetries of the remaining
+ * secrets, i.e. the peg and color permutations that map the set of
+ * remaining secrets onto itself (its stabilizer). A guess that such a
+ * permutation maps to a smaller codeword partitions the secrets in the
+ * same way up to the permutation, and is filtered out.
+ *
+ * The other filters only account for the symmetries implied by the
+ * guesses made and by the colors excluded. The remaining secrets may
+ * have more symmetries than that after a response, for example when
+ * they are invariant under swapping two guessed colors.
+ *
+ * Colors that are absent from the secrets are kept fixed, as they are
+ * handled by the color equivalence filter, and so are colors that have
+ * not been guessed, as they are handled by the constraint equivalence
+ * filter. This also keeps the search for symmetries short, since such
+ * colors can be permuted in many ways. If the stabilizer is large,
+ * only part of it is kept, which filters fewer guesses but is still
+ * correct: the smallest codeword of an orbit under the whole stabilizer
+ * is never mapped to a smaller one.
+ */
+class SymmetryEquivalenceFilter : public EquivalenceFilter
+{
+	const Engine *e;
+	ColorMask unguessed;
+
+	// All permutations of the pegs, shared by the copies of the filter.
+	std::shared_ptr<const std::vector<CodewordPermutation>> pegperms;
+
+	// Symmetries of the remaining secrets, other than the identity. They
+	// are kept in place so that cloning the filter does not allocate.
+	CodewordPermutation symmetries[MaxSymmetries];
+	size_t nsymmetries;
+
+	void find_symmetries(CodewordConstRange secrets);
+
+public:
+
+	SymmetryEquivalenceFilter(const Engine *engine);
+
+	/// Copies a filter, but only the symmetries in use.
+	SymmetryEquivalenceFilter(const SymmetryEquivalenceFilter &f)
+		: e(f.e), unguessed(f.unguessed), pegperms(f.pegperms),
+		nsymmetries(f.nsymmetries)
+	{
+		std::copy(f.symmetries + 0, f.symmetries + nsymmetries, symmetries);
+	}
+
+	virtual EquivalenceFilter* clone() const
+	{
+		return new SymmetryEquivalenceFilter(*this);
+	}
+
+	virtual void narrow_canonical_guesses(
+		CodewordConstRange candidates,
+		CodewordIndexList &subset) const;
+
+	virtual void add_constraint(
+		const Codeword &guess,
+		Feedback response,
+		CodewordConstRange remaining
+		);
+
+	virtual void append_state_key(std::string &key) const;
+};
+
+/// Initializes a symmetry equivalence filter.
+SymmetryEquivalenceFilter::SymmetryEquivalenceFilter(const Engine *engine)
+	: e(engine), unguessed(ColorMask::fill(e->rules().colors())),
+	nsymmetries(0)
+{
+	std::vector<CodewordPermutation> pp;
+	// Permute a bounded local copy of the pegs (see the constraint filter).
+	const int npegs = std::min(e->rules().pegs(), MM_MAX_PEGS);
+	int perm[MM_MAX_PEGS];
+	std::iota(perm + 0, perm + npegs, 0);
+	CodewordPermutation p;
+	do
+	{
+		for (int i = 0; i < npegs; ++i)
+			p.peg[i] = (int8_t)perm[i];
+		pp.push_back(p);
+	}
+	while (std::next_permutation(perm + 0, perm + npegs));
+	pegperms = std::make_shared<const std::vector<CodewordPermutation>>(pp);
+}
+
+// Finds the symmetries of the remaining secrets. For each peg permutation,
+// a color may only be mapped to a color whose occurrence count on each
+// peg matches after the pegs are permuted, and a fixed color must match
+// itself. Each complete assignment of the colors is then checked against
+// the secrets.
+void SymmetryEquivalenceFilter::find_symmetries(CodewordConstRange secrets)
+{
+	const int p = e->rules().pegs(), c = e->rules().colors();
+	const size_t n = secrets.size();
+
+	// Count the occurrence of each color on each peg, and sort the
+	// packed secrets for lookup.
+	unsigned int count[MM_MAX_COLORS][MM_MAX_PEGS] = { { 0 } };
+	std::vector<Codeword::compact_type> packed(n);
+	for (size_t k = 0; k < n; ++k)
+	{
+		for (int i = 0; i < p; ++i)
+			++count[secrets[k][i]][i];
+		packed[k] = secrets[k].pack();
+	}
+	std::sort(packed.begin(), packed.end());
+
+	// Find the colors to permute and the fixed colors to check.
+	int moving[MM_MAX_COLORS], nmoving = 0;
+	int fixed[MM_MAX_COLORS], nfixed = 0;
+	for (int x = 0; x < c; ++x)
+	{
+		if (std::count(count[x] + 0, count[x] + p, 0u) == p)
+			continue;
+		if (unguessed[x])
+			fixed[nfixed++] = x;
+		else
+			moving[nmoving++] = x;
+	}
+	if (nmoving == 0)
+		return;
+
+	// Base value of a packed codeword (see Codeword::pack()).
+	const Codeword::compact_type base = (p < 8)?
+		(Codeword::compact_type)(0xffffffff << (4*p)) : 0;
+
+	size_t trials = 0;
+	for (size_t j = 0; j < pegperms->size(); ++j)
+	{
+		CodewordPermutation perm = (*pegperms)[j];
+
+		// Find the colors that each color to permute may be mapped to.
+		unsigned int allowed[MM_MAX_COLORS];
+		bool feasible = true;
+		for (int r = 0; r < nfixed && feasible; ++r)
+		{
+			int x = fixed[r];
+			for (int i = 0; i < p && feasible; ++i)
+				feasible = (count[x][(int)perm.peg[i]] == count[x][i]);
+		}
+		for (int r = 0; r < nmoving && feasible; ++r)
+		{
+			int x = moving[r];
+			allowed[r] = 0;
+			for (int s = 0; s < nmoving; ++s)
+			{
+				int y = moving[s];
+				int i = 0;
+				while (i < p && count[y][(int)perm.peg[i]] == count[x][i])
+					++i;
+				if (i == p)
+					allowed[r] |= 1u << y;
+			}
+			feasible = (allowed[r] != 0);
+		}
+		if (!feasible)
+			continue;
+
+		// Enumerate the color assignments by backtracking. choice[r] is
+		// the set of colors left to try for moving[r].
+		unsigned int choice[MM_MAX_COLORS];
+		unsigned int used = 0;
+		int r = 0;
+		choice[0] = allowed[0];
+		while (r >= 0)
+		{
+			unsigned int left = choice[r] & ~used;
+			if (left == 0)
+			{
+				// Backtrack to the previous color.
+				if (--r >= 0)
+					used &= ~(1u << perm.color[moving[r]]);
+				continue;
+			}
+
+			int y = 0;
+			while (!(left & (1u << y)))
+				++y;
+			choice[r] &= ~(1u << y);
+			perm.color[moving[r]] = (int8_t)y;
+
+			if (r + 1 < nmoving)
+			{
+				used |= 1u << y;
+				++r;
+				choice[r] = allowed[r];
+				continue;
+			}
+
+			// Check the complete permutation against the secrets, unless
+			// it is the identity.
+			bool identity = (j == 0);
+			for (int s = 0; s < nmoving && identity; ++s)
+				identity = (perm.color[moving[s]] == moving[s]);
+			if (identity)
+				continue;
+
+			if (++trials > MaxSymmetryTrials)
+				return;
+			size_t k = 0;
+			for (; k < n; ++k)
+			{
+				Codeword::compact_type w = base;
+				for (int i = 0; i < p; ++i)
+				{
+					w |= (Codeword::compact_type)perm.color[secrets[k][i]]
+						<< (4*(p-1-perm.peg[i]));
+				}
+				if (!std::binary_search(packed.begin(), packed.end(), w))
+					break;
+			}
+			if (k == n)
+			{
+				symmetries[nsymmetries++] = perm;
+				if (nsymmetries >= MaxSymmetries)
+					return;
+			}
+		}
+	}
+}
+
+// Keeps the candidates that no symmetry maps to a smaller codeword.
+void SymmetryEquivalenceFilter::narrow_canonical_guesses(
+	CodewordConstRange candidates,
+	CodewordIndexList &subset) const
+{
+	if (nsymmetries == 0)
+		return;
+
+	const int p = e->rules().pegs();
+	const Codeword::compact_type base = (p < 8)?
+		(Codeword::compact_type)(0xffffffff << (4*p)) : 0;
+
+	const size_t n = subset.size();
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const uint32_t index = subset[i];
+		const Codeword candidate = candidates[index];
+		const Codeword::compact_type value = candidate.pack();
+		bool is_canonical = true;
+		for (size_t j = 0; j < nsymmetries && is_canonical; ++j)
+		{
+			const CodewordPermutation &perm = symmetries[j];
+			Codeword::compact_type w = base;
+			for (int k = 0; k < p; ++k)
+			{
+				w |= (Codeword::compact_type)perm.color[candidate[k]]
+					<< (4*(p-1-perm.peg[k]));
+			}
+			is_canonical = (w >= value);
+		}
+		subset[count] = index;
+		count += is_canonical;
+	}
+	subset.resize(count);
+
+	UPDATE_CALL_COUNTER("SymmetryEquivalence_Input", n);
+	UPDATE_CALL_COUNTER("SymmetryEquivalence_Output", count);
+	UPDATE_CALL_COUNTER("SymmetryEquivalence_Reduction", n - count);
+}
+
+void SymmetryEquivalenceFilter::add_constraint(
+	const Codeword &guess,
+	Feedback /* response */,
+	CodewordConstRange remaining)
+{
+	unguessed.reset(e->colorMask(guess));
+
+	// The symmetries of the remaining secrets are not related to those
+	// of the secrets before the guess, so they are found afresh.
+	nsymmetries = 0;
+	find_symmetries(remaining);
+	UPDATE_CALL_COUNTER("SymmetryEquivalence_Symmetries",
+		(unsigned int)nsymmetries);
+}
+
+// The key lists the symmetries kept, which alone determine the canonical
+// guesses.
+void SymmetryEquivalenceFilter::append_state_key(std::string &key) const
+{
+	const int p = e->rules().pegs(), c = e->rules().colors();
+	key.push_back((char)nsymmetries);
+	for (size_t j = 0; j < nsymmetries; ++j)
+	{
+		key.append((const char *)symmetries[j].peg, p);
+		key.append((const char *)symmetries[j].color, c);
+	}
+}
+
+EquivalenceFilter* CreateSymmetryEquivalenceFilter(const Engine *e)
+{
+	return new SymmetryEquivalenceFilter(e);
+}
+
+} // namespace Mastermind
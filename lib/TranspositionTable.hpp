@@ -0,0 +1,250 @@
+#ifndef MASTERMIND_TRANSPOSITION_TABLE_HPP
+#define MASTERMIND_TRANSPOSITION_TABLE_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include "Engine.hpp"
+#include "Strategy.hpp"
+#include "util/xorshift.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+/**
+ * Bounded transposition table that caches the results of subproblems
+ * solved by the optimal strategy search.
+ *
+ * Different guess sequences often leave the same set of remaining
+ * secrets (e.g. guessing @c a then @c b, or @c b then @c a). A subproblem
+ * is identified by the set of remaining secrets and the remaining depth.
+ * The state of the equivalence filters is not part of the key, because
+ * the filters only remove guesses that are equivalent to a kept one and
+ * therefore never change the optimal cost. For each subproblem, the table
+ * stores either the exact cost of the optimal strategy together with its
+ * first guess, or a proven lower bound of the cost.
+ *
+ * The table has a fixed number of buckets of two entries each. The first
+ * entry of a bucket keeps the larger subproblem (i.e. the one that took
+ * more work to solve); the second entry is always replaced. The table
+ * may be accessed concurrently by multiple threads.
+ *
+ * @ingroup Optimal
+ */
+class TranspositionTable
+{
+public:
+
+	/// Type of the cost stored in an entry.
+	enum BoundType
+	{
+		/// The entry is empty.
+		Empty = 0,
+
+		/// The cost is the exact cost of the optimal strategy.
+		Exact = 1,
+
+		/// The cost is a lower bound of the cost of any strategy.
+		LowerBound = 2
+	};
+
+	/// Identifies a subproblem by two independent 64-bit hash values.
+	struct Key
+	{
+		uint64_t h1, h2;
+	};
+
+	/// Stores the result of a subproblem.
+	struct Entry
+	{
+		/// Key of the subproblem.
+		Key key;
+
+		/// Exact cost or lower bound of the cost, including the initial
+		/// guess.
+		StrategyCost cost;
+
+		/// The first guess of the optimal strategy, packed. Only valid
+		/// if the cost is exact.
+		Codeword::compact_type guess;
+
+		/// Number of secrets in the subproblem, used to prioritize
+		/// entries that took more work to solve.
+		uint32_t size;
+
+		/// Type of the cost; see @c BoundType.
+		uint8_t type;
+
+		Entry() : cost(), guess(0), size(0), type(Empty)
+		{
+			key.h1 = key.h2 = 0;
+		}
+	};
+
+private:
+
+	std::vector<Entry> _entries;
+	size_t _mask;
+
+	static bool same_key(const Key &a, const Key &b)
+	{
+		return a.h1 == b.h1 && a.h2 == b.h2;
+	}
+
+public:
+
+	/// Creates a transposition table that takes up to the given number
+	/// of bytes of memory.
+	explicit TranspositionTable(size_t bytes)
+	{
+		// Use the largest power of two number of buckets that fits.
+		size_t nbuckets = 1;
+		while (nbuckets * 2 * 2 * sizeof(Entry) <= bytes)
+			nbuckets *= 2;
+		_entries.resize(nbuckets * 2);
+		_mask = nbuckets - 1;
+	}
+
+	/// Computes the key of a subproblem.
+	static Key make_key(
+		CodewordConstRange secrets,
+		int max_depth)
+	{
+		// The key must not depend on the order of the secrets.
+		std::vector<Codeword::compact_type> packed(secrets.size());
+		for (size_t i = 0; i < packed.size(); ++i)
+			packed[i] = secrets[i].pack();
+		std::sort(packed.begin(), packed.end());
+
+		Key key;
+		key.h1 = 14695981039346656037ULL ^ (uint64_t)max_depth;
+		key.h2 = util::xorshift64star::mix((uint64_t)max_depth);
+		for (size_t i = 0; i < packed.size(); ++i)
+		{
+			key.h1 = (key.h1 ^ packed[i]) * 1099511628211ULL;
+			key.h2 = util::xorshift64star::mix(key.h2 ^ packed[i]);
+		}
+
+		return key;
+	}
+
+	/// Looks up a subproblem. Returns @c true and stores the result in
+	/// @c entry if the subproblem is found.
+	bool probe(const Key &key, Entry &entry) const
+	{
+		const Entry *bucket = &_entries[(key.h1 & _mask) * 2];
+		bool found = false;
+		#pragma omp critical (TranspositionTable_Access)
+		{
+			for (int k = 0; k < 2 && !found; ++k)
+			{
+				if (bucket[k].type != Empty && same_key(bucket[k].key, key))
+				{
+					entry = bucket[k];
+					found = true;
+				}
+			}
+		}
+		if (found)
+			UPDATE_CALL_COUNTER("TranspositionTable_Hit", entry.size);
+		else
+			UPDATE_CALL_COUNTER("TranspositionTable_Miss", 0);
+		return found;
+	}
+
+	/// Stores the result of a subproblem.
+	void store(
+		const Key &key,
+		BoundType type,
+		const StrategyCost &cost,
+		const Codeword &guess,
+		size_t size)
+	{
+		assert(type != Empty);
+
+		Entry e;
+		e.key = key;
+		e.type = (uint8_t)type;
+		e.cost = cost;
+		e.guess = (type == Exact)? guess.pack() : 0;
+		e.size = (uint32_t)size;
+
+		Entry *bucket = &_entries[(key.h1 & _mask) * 2];
+		#pragma omp critical (TranspositionTable_Access)
+		if (bucket[0].type == Empty || same_key(bucket[0].key, key) ||
+			bucket[0].size <= e.size)
+		{
+			// Keep the displaced entry in the always-replace slot.
+			if (bucket[0].type != Empty && !same_key(bucket[0].key, key))
+				bucket[1] = bucket[0];
+			else if (same_key(bucket[1].key, key))
+				bucket[1] = Entry();
+			bucket[0] = e;
+		}
+		else
+		{
+			bucket[1] = e;
+		}
+	}
+
+	/// Writes the entries of the table to a stream in text format. The
+	/// table must not be accessed concurrently.
+	void save(std::ostream &os) const
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < _entries.size(); ++i)
+		{
+			if (_entries[i].type != Empty)
+				++count;
+		}
+		os << _entries.size() << ' ' << count << '\n';
+		for (size_t i = 0; i < _entries.size(); ++i)
+		{
+			const Entry &e = _entries[i];
+			if (e.type != Empty)
+			{
+				os << i << ' ' << e.key.h1 << ' ' << e.key.h2 << ' '
+					<< e.cost.steps << ' ' << e.cost.depth << ' '
+					<< e.cost.worst << ' ' << e.guess << ' ' << e.size
+					<< ' ' << (int)e.type << '\n';
+			}
+		}
+	}
+
+	/// Restores the entries written by <code>save()</code>, replacing
+	/// the content of the table. The table takes the size of the saved
+	/// table, so that it behaves exactly as the saved one. Returns
+	/// @c false if the input is invalid.
+	bool load(std::istream &is)
+	{
+		size_t n, count;
+		if (!(is >> n >> count) || n < 2 || (n & (n - 1)) != 0 || count > n)
+			return false;
+
+		std::vector<Entry> entries(n);
+		for (size_t k = 0; k < count; ++k)
+		{
+			size_t i;
+			unsigned int steps, depth, worst, type;
+			Entry e;
+			if (!(is >> i >> e.key.h1 >> e.key.h2 >> steps >> depth >> worst
+				>> e.guess >> e.size >> type) || i >= n ||
+				type == Empty || type > LowerBound)
+				return false;
+			e.cost = StrategyCost(steps, (unsigned short)depth, (unsigned short)worst);
+			e.type = (uint8_t)type;
+			entries[i] = e;
+		}
+
+		_entries.swap(entries);
+		_mask = n / 2 - 1;
+		return true;
+	}
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_TRANSPOSITION_TABLE_HPP
@@ -147,10 +147,14 @@ public:
 	static call_counter& get(const std::string &name)
 	{
 		registry_type &ccs = get_registry();
-		auto it = ccs.find(name);
-		if (it == ccs.end())
+		registry_type::iterator it;
+		#pragma omp critical (util_call_counter_registry)
 		{
-			it = ccs.insert(std::make_pair(name, call_counter(name))).first;
+			it = ccs.find(name);
+			if (it == ccs.end())
+			{
+				it = ccs.insert(std::make_pair(name, call_counter(name))).first;
+			}
 		}
 		return it->second;
 	}
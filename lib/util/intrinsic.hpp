@@ -179,9 +179,20 @@ inline int bit_scan_reverse(unsigned long long x)
 }
 #endif // defined(_WIN64)
 #else  // defined(_WIN32)
-DELEGATE_INTRINSIC(int, bit_scan_reverse, unsigned int, __builtin_clz)
-DELEGATE_INTRINSIC(int, bit_scan_reverse, unsigned long, __builtin_clzl)
-DELEGATE_INTRINSIC(int, bit_scan_reverse, unsigned long long, __builtin_clzll)
+// __builtin_clz counts the leading zero bits, so the position of the most
+// significant bit is the number of bits less one minus that count.
+inline int bit_scan_reverse(unsigned int x)
+{
+	return (int)(sizeof(x)*8-1) - __builtin_clz(x);
+}
+inline int bit_scan_reverse(unsigned long x)
+{
+	return (int)(sizeof(x)*8-1) - __builtin_clzl(x);
+}
+inline int bit_scan_reverse(unsigned long long x)
+{
+	return (int)(sizeof(x)*8-1) - __builtin_clzll(x);
+}
 DELEGATE_INTRINSIC_CAST(int, bit_scan_reverse, unsigned char, unsigned int)
 DELEGATE_INTRINSIC_CAST(int, bit_scan_reverse, unsigned short, unsigned int)
 #endif // defined(_WIN32)
@@ -278,14 +278,15 @@ inline unsigned int sum(const simd_t<uint8_t,16> &a)
 } } // namespace util::simd
 
 
-#if 0
+#if defined(__SSSE3__)
 #include <tmmintrin.h>
 
 namespace util { namespace simd {
-	
-#define SIMD_REQUIRE(version)
 
-SIMD_REQUIRE("SSSE3")
+/// Shuffles the bytes of a vector. Byte @c i of the result is the byte
+/// of @c a at index <code>perm[i] & 0x0f</code>, or zero if the most
+/// significant bit of <code>perm[i]</code> is set. Requires SSSE3.
+/// @ingroup SIMD
 inline simd_t<uint8_t,16> 
 shuffle(const simd_t<uint8_t,16> &a, const simd_t<int8_t,16> &perm)
 {
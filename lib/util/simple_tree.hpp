@@ -24,25 +24,51 @@ enum TraversalOrder
 /**
  * Represents a simple tree which only allows adding children to the last
  * node of each depth.
+ *
+ * The nodes are stored in preorder. Each node keeps the size of the branch
+ * rooted at it, so that the next sibling of a node is found in constant
+ * time. The branches on the path to the last node may still grow; their
+ * size is left open, and is set when a node is added elsewhere. Each node
+ * also keeps the index of its parent to find that path.
  */
 template <class T, class TDepth = size_t>
 class simple_tree
 {
 private:
 
-	//typedef TDepth TSize;
-
 	struct node_t
 	{
-		T data;     // user data associated with this node
-		//TSize size; // 1 + number of children of this node
-		TDepth depth;
-		//node_t(const T& _data) : data(_data), size(1) { }
-		node_t(const T& _data, TDepth _depth) : data(_data), depth(_depth) { }
+		T data;        // user data associated with this node
+		TDepth depth;  // depth of this node (root = 0)
+		size_t size;   // number of nodes in the branch, or 0 if open
+		size_t parent; // index of the parent node (0 for the root)
+		node_t(const T& _data, TDepth _depth, size_t _parent)
+			: data(_data), depth(_depth), size(0), parent(_parent) { }
 	};
 
 	std::vector<node_t> _nodes;
 
+	// Returns the position past the branch rooted at a node. An open
+	// branch extends to the end of the tree.
+	size_t branch_end(size_t index) const
+	{
+		size_t size = _nodes[index].size;
+		return (size == 0)? _nodes.size() : index + size;
+	}
+
+	// Prepares to add children to a node whose branch extends to the end
+	// of the tree. The branches below it on the path to the last node are
+	// complete, and the branches of the node and its ancestors are open.
+	// Each node is usually closed once, so this takes constant amortized
+	// time.
+	void open_branch(size_t where)
+	{
+		for (size_t i = _nodes.size() - 1; i != where; i = _nodes[i].parent)
+			_nodes[i].size = _nodes.size() - i;
+		for (size_t i = where; _nodes[i].size != 0; i = _nodes[i].parent)
+			_nodes[i].size = 0;
+	}
+
 	typedef simple_tree<T,TDepth> self_type;
 
 	/// Represents an abstract iterator that points to a specific node 
@@ -151,13 +177,7 @@ private:
 		/// where the next sibling would have been inserted.
 		sibling_iterator& operator ++ ()
 		{
-			typename Base::Tree *tree = Base::_tree;
-			size_t index = Base::_index;
-			TDepth d = tree->_nodes[index].depth;
-			size_t i = index + 1;
-			while (i < tree->_nodes.size() && tree->_nodes[i].depth > d)
-				++i;
-			Base::_index = i;
+			Base::_index = Base::_tree->branch_end(Base::_index);
 			return *this;
 		}
 	};
@@ -209,7 +229,7 @@ public:
 	/// Creates a tree with the given root data.
 	simple_tree(const T& root_data)
 	{
-		_nodes.push_back(node_t(root_data, 0));
+		_nodes.push_back(node_t(root_data, 0, 0));
 	}
 
 	/// Returns the number of nodes in the tree, including the root node.
@@ -277,10 +297,51 @@ public:
 		assert((++it)._index == _nodes.size());
 
 		// Append the child to the end of the tree.
-		_nodes.push_back(node_t(data, where.depth() + 1));
+		open_branch(where._index);
+		_nodes.push_back(node_t(data, where.depth() + 1, where._index));
 		return iterator(this, _nodes.size() - 1);
 	}
 
+	/**
+	 * Removes the nodes at positions <code>[first, last)</code> in preorder.
+	 * The positions are values returned by <code>size()</code> at the time
+	 * the nodes are appended, so that nodes appended since then can be
+	 * removed without copying. The removed nodes must form entire branches.
+	 *
+	 * @remarks Iterators to the nodes before @c first are still valid.
+	 */
+	void erase(size_t first, size_t last)
+	{
+		assert(first > 0 && first <= last && last <= _nodes.size());
+
+		// Remove each branch from the size of its ancestors that are
+		// complete. The ancestors of an open branch are open.
+		for (size_t i = first; i < last; )
+		{
+			size_t end = branch_end(i);
+			assert(end <= last);
+			size_t j = _nodes[i].parent;
+			for (; _nodes[j].size != 0; j = _nodes[j].parent)
+				_nodes[j].size -= end - i;
+			i = end;
+		}
+		_nodes.erase(_nodes.begin() + first, _nodes.begin() + last);
+
+		// Update the parent of the nodes moved.
+		const size_t count = last - first;
+		for (size_t i = first; i < _nodes.size(); ++i)
+		{
+			if (_nodes[i].parent >= last)
+				_nodes[i].parent -= count;
+		}
+	}
+
+	/// Removes the nodes appended since the tree had @c size nodes.
+	void rollback(size_t size)
+	{
+		erase(size, _nodes.size());
+	}
+
 	/**
 	 * Inserts another tree as child of an existing node.
 	 *
@@ -310,15 +371,22 @@ public:
 		iterator ret(this, _nodes.size());
 
 		// Append the subtree to the end of the tree. We need to update the
-		// depth field of the tree.
+		// depth and parent fields of the tree; the size of each branch is
+		// unchanged, and the open branches of the subtree stay open.
+		open_branch(where._index);
 		size_t offset = has_root ? 0 : 1;
 		_nodes.reserve(_nodes.size() + subtree._nodes.size() - offset);
 		size_t base_depth = where.depth() + 1 - offset;
+		size_t base_index = _nodes.size() - offset;
 		size_t n = subtree._nodes.size();
 		for (size_t i = offset; i < n; ++i)
 		{
 			const node_t &child = subtree._nodes[i];
-			_nodes.push_back(node_t(child.data, child.depth + (TDepth)base_depth));
+			bool top = (child.depth == (TDepth)offset);
+			node_t node(child.data, child.depth + (TDepth)base_depth,
+				top? where._index : base_index + child.parent);
+			node.size = child.size;
+			_nodes.push_back(node);
 		}
 		return ret;
 	}
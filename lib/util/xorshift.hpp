@@ -0,0 +1,67 @@
+/// @defgroup Random Pseudo-Random Number Generator
+/// @ingroup util
+
+#ifndef UTILITIES_XORSHIFT_HPP
+#define UTILITIES_XORSHIFT_HPP
+
+#include <cstdint>
+
+namespace util {
+
+/**
+ * Fast pseudo-random number generator using the xorshift64* algorithm
+ * (Marsaglia, 2003; Vigna, 2014). The generator has a period of
+ * <code>2^64-1</code> and keeps only 64 bits of state, so it is cheap
+ * to create a generator on the fly, e.g. one per call.
+ *
+ * @ingroup Random
+ */
+class xorshift64star
+{
+	uint64_t _state;
+
+public:
+
+	/// Type of the random numbers generated.
+	typedef uint64_t result_type;
+
+	/// Creates a generator with the given seed. The seed is scrambled
+	/// first so that similar seeds produce unrelated sequences.
+	explicit xorshift64star(uint64_t seed = 0) : _state(mix(seed))
+	{
+		// The state must not be zero.
+		if (_state == 0)
+			_state = 0x9E3779B97F4A7C15ULL;
+	}
+
+	/// Returns the next random number.
+	result_type operator () ()
+	{
+		uint64_t x = _state;
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		_state = x;
+		return x * 0x2545F4914F6CDD1DULL;
+	}
+
+	/// Returns a random integer in <code>[0, n)</code>. The modulo bias
+	/// is negligible for small @c n.
+	result_type uniform(result_type n)
+	{
+		return n == 0 ? 0 : (*this)() % n;
+	}
+
+	/// Scrambles a 64-bit value using the finalizer of the splitmix64
+	/// generator. This is useful to derive a seed from a hash value.
+	static uint64_t mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+};
+
+} // namespace util
+
+#endif // UTILITIES_XORSHIFT_HPP
@@ -39,6 +39,10 @@
 /// A strategy that makes the optimal guess through exhaustive search.
 /// @ingroup strat
 
+/// @defgroup Randomized Randomized Strategy
+/// A strategy that makes a random guess among the best few guesses.
+/// @ingroup strat
+
 #include <iostream>
 #include <vector>
 #include <string>
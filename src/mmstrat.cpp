@@ -2,10 +2,19 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <fstream>
 #include <sstream>
+#include <stdexcept>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#ifndef _WIN32
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#endif
 
 #include <iostream>
 #include "Rules.hpp"
@@ -13,6 +22,7 @@
 #include "Equivalence.hpp"
 #include "SimpleStrategy.hpp"
 #include "HeuristicStrategy.hpp"
+#include "RandomizedStrategy.hpp"
 #include "OptimalStrategy.hpp"
 #include "CodeBreaker.hpp"
 #include "Heuristics.hpp"
@@ -177,6 +187,7 @@ static void usage()
 		"    minavg      min-average heuristic strategy\n"
 		"    entropy     max-entropy heuristic strategy\n"
 		"    parts       max-parts heuristic strategy\n"
+		"    random      randomized min-average heuristic strategy\n"
 #ifndef NDEBUG
 		"    minlb       min-lowerbound heuristic strategy\n"
 #endif
@@ -199,23 +210,66 @@ static void usage()
 		"                default     composite filter (color + constraint)\n"
 		"                color       filter by color equivalence\n"
 		"                constraint  filter by constraint equivalence\n"
+		"                symmetry    filter by symmetries of remaining possibilities\n"
 		"                none        do not apply any filter\n"
+		"    -memo       reuse the guess made for an equivalent set of remaining\n"
+		"                possibilities (up to peg and color permutation)\n"
 		"    -nc         do not apply a correction to the heuristic score\n"
 		"                which favors guesses from remaining possibilities.\n" 
 		"    -no         Do not attempt to make an obvious guess before applying\n"
 		"                the heuristic function. This option is useful for debugging\n"
 		"                purpose if the heuristic function may yield a guess that\n"
 		"                is different than an obvious guess when one exists.\n"
+		"    -k n        make a random guess among the n best guesses for the\n"
+		"                random strategy [default=3]\n"
+		"    -seed n     seed the random number generator of the random\n"
+		"                strategy with n [default=0]\n"
 		"Options for Optimal Strategies:\n"
-#ifndef NDEBUG
+		"    -ci sec     with -ckpt or -resume, save a checkpoint at most every\n"
+		"                'sec' seconds [default=600]\n"
+		"    -ckpt path  save checkpoints of the search to 'path' periodically\n"
+		"    -gc size    cache the canonical guesses of each state of the\n"
+		"                equivalence filters in 'size' megabytes [default=64]\n"
+		"    -listen address\n"
+		"                with -workers, wait for the workers to connect to\n"
+		"                'address' (unix:path or host:port) instead of starting them\n"
 		"    -md depth   set the maximum number of guesses allowed to reveal a secret\n"
-#endif
 		"    -O level    specify the level of optimization, which is one of:\n"
 		"                1 - (default) minimize steps\n"
 #ifndef NDEBUG
 		"                2 - minimize steps, then depth\n"
 		"                3 - minimize steps, then depth, then worst count\n"
 #endif
+		"                depth - minimize depth only\n"
+		"                worst - minimize depth, then worst count\n"
+#ifdef _OPENMP
+		"    -pd depth   with -mt, search the guesses of the top 'depth' levels\n"
+		"                in parallel [default=2]\n"
+#endif
+		"    -resume path\n"
+		"                resume the search from the checkpoint saved in 'path',\n"
+		"                and keep saving checkpoints to it\n"
+		"    -states n   stop after searching 'n' states and output the best\n"
+		"                strategy found so far [default=0, unlimited]\n"
+		"    -stats path write the statistics of the search by depth to 'path'\n"
+		"                in JSON format\n"
+		"    -store path read solved subproblems from the store file 'path', and\n"
+		"                append those solved by this search to it; not used\n"
+		"                with -po\n"
+		"    -time sec   stop after 'sec' seconds and output the best strategy\n"
+		"                found so far [default=0, unlimited]\n"
+		"    -tt size    cache solved subproblems in a transposition table of\n"
+		"                'size' megabytes [default=0, disabled]; not used\n"
+		"                with -po\n"
+		"    -ub size    seed the cut-off of each subproblem with at least 'size'\n"
+		"                secrets with the cost of a heuristic strategy\n"
+		"                [default=0, disabled]\n"
+		"    -worker address\n"
+		"                run as a worker of the distributed search whose\n"
+		"                coordinator listens on 'address'\n"
+		"    -workers n  search the guesses of the root on 'n' worker processes\n"
+		"                started locally, or connected to -listen; not used\n"
+		"                with -O depth or -O worst [default=0]\n"
 		"";
 }
 
@@ -230,6 +284,48 @@ static void version()
 		"";
 }
 
+/// Starts worker processes of a distributed search, which run this program
+/// with the same arguments except that they connect to the coordinator at
+/// @c address. Returns the ids of the processes started.
+static std::vector<int> spawn_workers(
+	int argc, char *argv[], const std::string &address, size_t count)
+{
+	std::vector<int> pids;
+#ifndef _WIN32
+	std::vector<std::string> args;
+	for (int i = 0; i < argc; i++)
+	{
+		std::string s = argv[i];
+		if (s == "-workers" || s == "-listen")
+			++i;
+		else
+			args.push_back(s);
+	}
+	args.push_back("-worker");
+	args.push_back(address);
+
+	std::vector<char *> arg_ptrs;
+	for (size_t i = 0; i < args.size(); i++)
+		arg_ptrs.push_back(&args[i][0]);
+	arg_ptrs.push_back(NULL);
+
+	const char *path = (access("/proc/self/exe", X_OK) == 0)?
+		"/proc/self/exe" : argv[0];
+	for (size_t k = 0; k < count; k++)
+	{
+		pid_t pid;
+		if (posix_spawn(&pid, path, NULL, NULL, arg_ptrs.data(), environ) == 0)
+			pids.push_back((int)pid);
+	}
+#else
+	(void)argc;
+	(void)argv;
+	(void)address;
+	(void)count;
+#endif
+	return pids;
+}
+
 // TODO: Add progress display to OptimalCodeBreaker
 // TODO: Output strategy tree after finishing a run
 
@@ -247,44 +343,49 @@ extern int test(const Rules &rules, bool verbose);
 static int build_heuristic_strategy_tree(
 	const Engine *e, const EquivalenceFilter *filter, int /* verbose */,
 	const std::string &name, StrategyConstraints constraints,
-	bool no_correction, StrategyTree &tree)
+	bool no_correction, bool memoize, int random_k, unsigned long long seed,
+	StrategyTree &tree)
 {
 	using namespace Mastermind::Heuristics;
 
 	bool ac = !no_correction; // apply correction
-	Strategy *strat = NULL;
+	std::unique_ptr<Strategy> strat;
 	if (name == "simple")
-		strat = new SimpleStrategy();
+		strat.reset(new SimpleStrategy());
 	else if (name == "minmax")
-		strat = new HeuristicStrategy<MinimizeWorstCase>(e, MinimizeWorstCase(ac));
+		strat.reset(new HeuristicStrategy<MinimizeWorstCase>(e, MinimizeWorstCase(ac)));
 	else if (name == "minavg")
-		strat = new HeuristicStrategy<MinimizeAverage>(e, MinimizeAverage(ac));
+		strat.reset(new HeuristicStrategy<MinimizeAverage>(e, MinimizeAverage(ac)));
 	else if (name == "entropy")
-		strat = new HeuristicStrategy<MaximizeEntropy>(e, MaximizeEntropy(ac));
+		strat.reset(new HeuristicStrategy<MaximizeEntropy>(e, MaximizeEntropy(ac)));
 	else if (name == "parts")
-		strat = new HeuristicStrategy<MaximizePartitions>(e, MaximizePartitions(ac));
+		strat.reset(new HeuristicStrategy<MaximizePartitions>(e, MaximizePartitions(ac)));
+	else if (name == "random")
+		strat.reset(new RandomizedStrategy(
+			new HeuristicStrategy<MinimizeAverage>(e, MinimizeAverage(ac)),
+			random_k, seed));
 	else if (name == "minlb")
-		strat = new HeuristicStrategy<MinimizeLowerBound>(e, MinimizeLowerBound(e));
+		strat.reset(new HeuristicStrategy<MinimizeLowerBound>(e, MinimizeLowerBound(e)));
 	else
 		USAGE_ERROR("unknown strategy: " << name);
 
 	CodeBreakerOptions options;
 	options.optimize_obvious = (name == "simple")? false : constraints.use_obvious;
 	options.possibility_only = constraints.pos_only;
+	options.memoize = (name == "simple")? false : memoize;
 	std::unique_ptr<EquivalenceFilter> copy(filter->clone());
-	tree = BuildStrategyTree(e, strat, copy.get(), options);
+	tree = BuildStrategyTree(e, strat.get(), copy.get(), options);
 	return 0;
 }
 
-extern StrategyTree build_optimal_strategy_tree(
-	const Engine *e, StrategyObjective obj, StrategyConstraints constraints);
-
 // verbose: 0 = quiet, 1 = verbose, 2 = very verbose
 static int build_strategy(
 	const Engine *e, const EquivalenceFilter *filter, int verbose,
 	const std::string &name, const std::string & /* file */,
-	StrategyConstraints constraints, bool no_correction,
-	StrategyObjective obj, bool summary)
+	StrategyConstraints constraints, bool no_correction, bool memoize,
+	int random_k, unsigned long long seed,
+	StrategyObjective obj, int depth_first, const OptimalSearchOptions &search,
+	const std::string &stats_file, bool summary)
 {
 	using namespace Mastermind::Heuristics;
 
@@ -294,14 +395,45 @@ static int build_strategy(
 	{
 		USAGE_ERROR("Not implemented");
 	}
+	else if (name == "optimal" && depth_first)
+	{
+		tree = build_depth_optimal_strategy_tree(e, depth_first > 1,
+			constraints, search);
+	}
 	else if (name == "optimal")
 	{
-		tree = build_optimal_strategy_tree(e, obj, constraints);
+		OptimalSearchResult result;
+		try
+		{
+			tree = build_optimal_strategy_tree(e, obj, constraints, search, &result);
+		}
+		catch (const std::runtime_error &ex)
+		{
+			std::cerr << "Error: " << ex.what() << "." << std::endl;
+			return 1;
+		}
+		if (!result.complete)
+		{
+			std::cerr << "Warning: search limit reached; the strategy found takes "
+				<< result.upper_bound << " steps and is not proven optimal "
+				<< "(lower bound: " << result.lower_bound << ")." << std::endl;
+		}
+		if (!stats_file.empty())
+		{
+			std::ofstream os(stats_file.c_str());
+			result.statistics.write_json(os);
+			if (!os)
+			{
+				std::cerr << "Error: cannot write statistics to " << stats_file
+					<< "." << std::endl;
+				return 1;
+			}
+		}
 	}
 	else
 	{
 		int ret = build_heuristic_strategy_tree(e, filter, verbose, name,
-			constraints, no_correction, tree);
+			constraints, no_correction, memoize, random_k, seed, tree);
 		if (ret)
 			return ret;
 	}
@@ -343,9 +475,17 @@ int main(int argc, char* argv[])
 #endif
 	StrategyConstraints constraints;
 	StrategyObjective obj = MinSteps;
+	int depth_first = 0; // 1 = minimize depth, 2 = then worst count
+	OptimalSearchOptions search;
+	int parallel_depth = 2;
 	bool prof = false; // whether to enable profiling (call counting)
 	bool no_correction = false;
+	bool memoize = false;
 	bool summary = false;
+	int random_k = 3;
+	unsigned long long seed = 0;
+	std::string worker_address;
+	std::string stats_file;
 
 	// Parse command line arguments.
 	for (int i = 1; i < argc; i++)
@@ -362,6 +502,13 @@ int main(int argc, char* argv[])
 			usage();
 			return 0;
 		}
+		else if (s == "-k")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -k");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE((std::istringstream(cnt) >> random_k) && (random_k > 0),
+				"positive integer argument expected for option -k");
+		}
 		else if (s == "-md")
 		{
 			USAGE_REQUIRE(++i < argc, "missing argument for option -md");
@@ -400,6 +547,10 @@ int main(int argc, char* argv[])
 				" and is ignored." << std::endl;
 #endif
 		}
+		else if (s == "-memo")
+		{
+			memoize = true;
+		}
 		else if (s == "-nc")
 		{
 			no_correction = true;
@@ -414,6 +565,10 @@ int main(int argc, char* argv[])
 			std::string level = argv[i];
 			if (level == "1")
 				obj = MinSteps;
+			else if (level == "depth")
+				depth_first = 1;
+			else if (level == "worst")
+				depth_first = 2;
 			else
 				USAGE_ERROR("invalid optimization level '" << level << "'");
 		}
@@ -465,6 +620,98 @@ int main(int argc, char* argv[])
 			}
 #endif
 		}
+		else if (s == "-seed")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -seed");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> seed,
+				"integer argument expected for option -seed");
+		}
+		else if (s == "-pd")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -pd");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> parallel_depth,
+				"integer argument expected for option -pd");
+		}
+		else if (s == "-ckpt" || s == "-resume")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option " << s);
+			search.checkpoint_file = argv[i];
+			search.resume = (s == "-resume");
+		}
+		else if (s == "-store")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -store");
+			search.store_file = argv[i];
+		}
+		else if (s == "-stats")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -stats");
+			stats_file = argv[i];
+			search.collect_statistics = true;
+		}
+		else if (s == "-listen")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -listen");
+			search.listen_address = argv[i];
+		}
+		else if (s == "-worker")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -worker");
+			worker_address = argv[i];
+		}
+		else if (s == "-workers")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -workers");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> search.workers,
+				"integer argument expected for option -workers");
+		}
+		else if (s == "-ci")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -ci");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE((std::istringstream(cnt) >> search.checkpoint_interval) &&
+				(search.checkpoint_interval >= 0),
+				"non-negative number expected for option -ci");
+		}
+		else if (s == "-gc")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -gc");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> search.guess_cache_size,
+				"integer argument expected for option -gc");
+		}
+		else if (s == "-states")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -states");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> search.state_limit,
+				"integer argument expected for option -states");
+		}
+		else if (s == "-time")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -time");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE((std::istringstream(cnt) >> search.time_limit) &&
+				(search.time_limit >= 0),
+				"non-negative number expected for option -time");
+		}
+		else if (s == "-tt")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -tt");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> search.tt_size,
+				"integer argument expected for option -tt");
+		}
+		else if (s == "-ub")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -ub");
+			std::string cnt(argv[i]);
+			USAGE_REQUIRE(std::istringstream(cnt) >> search.seed_size,
+				"integer argument expected for option -ub");
+		}
 		else if (s == "-v")
 		{
 			version();
@@ -477,12 +724,20 @@ int main(int argc, char* argv[])
 	}
 
 	// Check that a strategy is specified.
-	USAGE_REQUIRE(!strat_name.empty(), "option -s strategy is required.");
+	USAGE_REQUIRE(!strat_name.empty() || !worker_address.empty(),
+		"option -s strategy is required.");
+
+	// The depth-first search runs in this process only.
+	USAGE_REQUIRE(!(depth_first && (search.workers > 0 ||
+		!search.listen_address.empty())),
+		"options -workers and -listen cannot be used with -O depth or -O worst");
 
 	// Set number of threads.
 #ifdef _OPENMP
 	omp_set_num_threads(mt);
 	omp_set_nested(0);
+	if (mt > 1)
+		search.parallel_depth = parallel_depth;
 #endif
 
 	// Enables or disables profiling according to -prof switch.
@@ -492,6 +747,39 @@ int main(int argc, char* argv[])
 	Engine engine(rules);
 	const Engine *e = &engine;
 
+	// Run as a worker of a distributed search if requested.
+	if (!worker_address.empty())
+	{
+		try
+		{
+			serve_optimal_search(e, obj, constraints, search, worker_address);
+		}
+		catch (const std::runtime_error &ex)
+		{
+			std::cerr << "Error: " << ex.what() << "." << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Start the workers of a distributed search unless they are to
+	// connect to the given address.
+	std::vector<int> worker_pids;
+	if (strat_name == "optimal" && search.workers > 0 &&
+		search.listen_address.empty())
+	{
+#ifndef _WIN32
+		std::ostringstream address;
+		address << "unix:/tmp/mmstrat-" << getpid() << ".sock";
+		search.listen_address = address.str();
+		worker_pids = spawn_workers(argc, argv, search.listen_address,
+			search.workers);
+		search.workers = worker_pids.size();
+#else
+		USAGE_ERROR("option -workers requires -listen on this platform");
+#endif
+	}
+
 	// Create the specified equivalence filter.
 	EquivalenceFilter *filter = NULL;
 	if (filter_name == "default" || filter_name == "")
@@ -508,6 +796,10 @@ int main(int argc, char* argv[])
 	{
 		filter = CreateConstraintEquivalenceFilter(e);
 	}
+	else if (filter_name == "symmetry")
+	{
+		filter = CreateSymmetryEquivalenceFilter(e);
+	}
 	else if (filter_name == "none")
 	{
 		filter = CreateDummyEquivalenceFilter(e);
@@ -520,7 +812,19 @@ int main(int argc, char* argv[])
 
 	// Build the specified strategy for the given rules.
 	int ret = build_strategy(e, filter, verbose, strat_name, strat_file, 
-		constraints, no_correction, obj, summary);
+		constraints, no_correction, memoize, random_k, seed, obj, depth_first,
+		search, stats_file, summary);
+
+#ifndef _WIN32
+	// The workers exit once the search is done. If the search failed
+	// before they connected, stop them.
+	for (size_t k = 0; k < worker_pids.size(); k++)
+	{
+		if (ret != 0)
+			kill((pid_t)worker_pids[k], SIGTERM);
+		waitpid((pid_t)worker_pids[k], NULL, 0);
+	}
+#endif
 
 	// Display available profiling results. It is useful to disgard the 
 	// profiling switch here to detect any code that doesn't respect the
@@ -5,6 +5,7 @@
 
 use strict;
 use warnings;
+use JSON::PP;
 
 # Path to executable.
 my $exec = 'mmstrat';
@@ -17,6 +18,13 @@ if ($#ARGV >= 0)
 print "$exec -v\n";
 system($exec, "-v") == 0 or exit $?;
 
+# Let -mt use several threads even on a single core, so that the tests
+# below exercise the parallel search.
+$ENV{OMP_NUM_THREADS} = 4;
+
+# Remove the checkpoint left by a previous run, which must not be resumed.
+unlink('test-mmstrat.ckpt');
+
 # Counter for test number.
 my $number = 0;
 my $failed = 0;
@@ -45,30 +53,72 @@ my @test_cases = (
 	"-r mm -s parts -nc",       "5684:6:7",
 	"-r mm -s parts -po",       "5714:7:2",
 
+	# Test randomized strategy. With -k 1 it reduces to the heuristic.
+	"-r mm -s random",          "5760:6:8",
+	"-r mm -s random -seed 7",  "5773:6:2",
+	"-r mm -s random -k 1",     "5696:6:3",
+
 	# Test optimal strategies.
 	"-r mm -s optimal",         "5625:6:7",
 	"-r mm -s optimal -O 1",    "5625:6:7",
+	"-r p4c4n -s optimal",      "86:6:1",
 	"-r mm -s optimal -po",     "5629:6:7",
 	"-r bc -s optimal -po",     "26374:7:126",
+	"-r mm -s optimal -tt 16",  "5625:6:7",
+	"-r p3c9r -s optimal -tt 16", "3596:7:3",
+	"-r mm -s optimal -po -tt 16", "5629:6:7",
+	"-r mm -s optimal -gc 0",   "5625:6:7",
+	"-r mm -s optimal -time 600", "5625:6:7",
+	"-r mm -s optimal -po -time 600", "5629:6:7",
+	"-r mm -s optimal -ub 50",  "5625:6:7",
+	"-r p3c9r -s optimal -po -ub 20", "3620:7:10",
+	# Stop a search after 1000 states while saving a checkpoint whenever
+	# possible, and resume it; the resume fails if no checkpoint was saved.
+	"-r mm -s optimal -ckpt test-mmstrat.ckpt -ci 0 -states 1000", "5673:6:13",
+	"-r mm -s optimal -resume test-mmstrat.ckpt", "5625:6:7",
+	"-r mm -s optimal -store test-mmstrat.store", "5625:6:7",
+	"-r mm -s optimal -po -store test-mmstrat.store", "5629:6:7",
+	"-r mm -s optimal -store test-mmstrat.store", "5625:6:7",
+	"-r mm -s optimal -stats test-mmstrat.json", "5625:6:7",
 
 	# Test -md switch for optimal strategies.
-	#"-r mm -s optimal -md 10",  "5625:6:7",
-	#"-r mm -s optimal -md 6",   "5625:6:7",
-	#"-r mm -s optimal -md 5",   "5626:5:x",
-	#"-r mm -s optimal -md 4",   "0:0:0",
+	"-r mm -s optimal -md 10",  "5625:6:7",
+	"-r mm -s optimal -md 6",   "5625:6:7",
+	"-r mm -s optimal -md 5",   "5626:5:556",
+	"-r mm -s optimal -md 4",   "0:0:0",
+
+	# Test strategies of minimum depth.
+	"-r mm -s optimal -O depth", "5731:5:628",
+	"-r mm -s optimal -O depth -md 4", "0:0:0",
+	"-r mm -s optimal -O worst", "5675:5:539",
+	"-r mm -s optimal -O depth -po -tt 16", "5717:5:629",
+	"-r p3c5r -s optimal -O worst", "485:5:1",
+	"-r bc -s optimal -O depth", "27523:7:345",
 
 	# Test different equivalence filters.
 	"-r mm -s minavg -e default",    "5696:6:3",
 	"-r mm -s minavg -e constraint", "5696:6:3",
 	"-r mm -s minavg -e color",      "5696:6:3",
+	"-r mm -s minavg -e symmetry",   "5696:6:3",
 	"-r mm -s minavg -e none",       "5696:6:3",
 
+	# Test memoization of guesses for equivalent states.
+	"-r mm -s minmax -memo",    "5778:5:663",
+	"-r bc -s minavg -memo",    "26551:7:87",
+	"-r bc -s entropy -memo",   "26409:8:1",
+
 	# Build strategy using 2 threads.
 	"-r mm -mt 2 -s minmax",    "5778:5:663",
 	"-r mm -mt 2 -s minavg",    "5696:6:3",
 	"-r mm -mt 2 -s entropy",   "5719:6:18",
 	"-r mm -mt 2 -s parts",     "5668:6:7",
 	"-r mm -mt 2 -s optimal",   "5625:6:7",
+	"-r mm -mt 2 -s optimal -po", "5629:6:7",
+	"-r p3c9r -mt 2 -s optimal -pd 3", "3596:7:3",
+
+	# Search the guesses of the root on local worker processes.
+	"-r mm -s optimal -workers 2", "5625:6:7",
+	"-r p3c9r -s optimal -workers 3", "3596:7:3",
 
 	# Test Bulls and Cows rule for selected strategies.
 	"-r bc -s simple",          "27511:8:41",
@@ -76,6 +126,7 @@ my @test_cases = (
 	"-r bc -s minavg",          "26551:7:87",
 	"-r bc -s entropy",         "26409:8:1",
 	"-r bc -s parts",           "26751:8:3",
+	"-r bc -s random -k 1",     "26551:7:87",
 	
 	# Test other rules.
 	"-r lg -mt 2 -s minavg",    "180287:7:789",
@@ -115,6 +166,102 @@ for (my $i = 0; $i < $#test_cases; $i += 2)
 	}
 }
 
+# Check the statistics saved by -stats: each level has the expected keys,
+# the candidates pruned are among those whose partition is computed, and
+# the totals are the sums over the levels.
+print "Checking statistics ... ";
+my @stats_errors;
+if (open(my $fh, '<', 'test-mmstrat.json'))
+{
+	local $/;
+	my $stats = decode_json(<$fh>);
+	close($fh);
+	my @counts = qw(states candidates pruned_by_bound pruned_midway
+		obvious solved first_best);
+	my @keys = sort('depth', @counts, 'first_best_rate', 'seconds');
+	my %sum = map { $_ => 0 } @counts;
+	foreach my $level (@{$stats->{levels}})
+	{
+		my $d = $level->{depth};
+		push @stats_errors, "unexpected keys at depth $d"
+			if join(',', sort keys %$level) ne join(',', @keys);
+		push @stats_errors, "more candidates pruned than computed at depth $d"
+			if $level->{pruned_by_bound} + $level->{pruned_midway}
+				> $level->{candidates};
+		push @stats_errors, "more first best than solved at depth $d"
+			if $level->{first_best} > $level->{solved};
+		$sum{$_} += $level->{$_} foreach @counts;
+	}
+	foreach my $key (@counts)
+	{
+		push @stats_errors, "total $key is not the sum of the levels"
+			if $stats->{total}->{$key} != $sum{$key};
+	}
+}
+else
+{
+	push @stats_errors, "cannot read test-mmstrat.json";
+}
+if (@stats_errors)
+{
+	print "FAILED\n";
+	print "    $_\n" foreach @stats_errors;
+	++$failed;
+	$last_is_ok = 0;
+}
+else
+{
+	print "\r";
+	$last_is_ok = 1;
+}
+++$number;
+
+# Compare the strategy trees found by the parallel search with those found
+# by the serial search. Each entry gives the arguments of the run to check
+# and of the reference run; the "-q" switch is automatically appended. The
+# last entry reads back from the store the subproblems solved in parallel.
+my @tree_cases = (
+	"-r p3c9r -s optimal -mt 4 -pd 3",         "-r p3c9r -s optimal",
+	"-r p3c9r -s optimal -mt 4 -pd 3 -tt 16",  "-r p3c9r -s optimal",
+	"-r p4c5r -s optimal -mt 4 -pd 3 -tt 16",  "-r p4c5r -s optimal",
+	"-r mm -s optimal -mt 4 -pd 2 -tt 16",     "-r mm -s optimal",
+	"-r p3c9r -s optimal -mt 4 -pd 3 -store test-mmstrat-mt.store",
+		"-r p3c9r -s optimal",
+	"-r p3c9r -s optimal -store test-mmstrat-mt.store", "-r p3c9r -s optimal",
+);
+
+unlink('test-mmstrat-mt.store');
+for (my $i = 0; $i < $#tree_cases; $i += 2)
+{
+	my $args = "-q $tree_cases[$i]";
+	my $ref_args = "-q $tree_cases[$i+1]";
+	print sprintf("Comparing tree [ %2d / %2d ] ... ",
+		$i/2 + 1, ($#tree_cases+1)/2);
+	++$number;
+
+	my $actual = `$exec $args`;
+	my $expect = `$exec $ref_args`;
+	if ($? == 0 && $actual ne '' && $actual eq $expect)
+	{
+		print "\r";
+		$last_is_ok = 1;
+	}
+	else
+	{
+		print "FAILED\n";
+		print "    Args:      $args\n";
+		print "    Reference: $ref_args\n";
+		++$failed;
+		$last_is_ok = 0;
+	}
+}
+
+# Remove the checkpoint, store and statistics files saved by the tests.
+unlink('test-mmstrat.ckpt');
+unlink('test-mmstrat-mt.store');
+unlink('test-mmstrat.store');
+unlink('test-mmstrat.json');
+
 # Display summary.
 print "\n" if $last_is_ok;
 if ($failed == 0)